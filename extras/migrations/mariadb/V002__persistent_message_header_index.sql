@@ -0,0 +1,5 @@
+ALTER TABLE persistent_message
+    ADD KEY IF NOT EXISTS idx_persistent_avatar_status_id (avatar_id, status, id),
+    DROP KEY IF EXISTS idx_persistent_avatar_status;
+
+INSERT IGNORE INTO schema_version (version, applied_at) VALUES (2, UNIX_TIMESTAMP());
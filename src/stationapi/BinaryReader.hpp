@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/** Raised when a packet ends before the field being decoded. */
+class SerializationException : public std::runtime_error {
+public:
+    explicit SerializationException(const std::string& message)
+        : std::runtime_error(message) {}
+};
+
+/** Non-owning reader over a received packet accepted by every read(StreamT&, ...) overload.
+*
+* It mirrors the std::istream read/seekg/tellg interface used by Serialization.hpp, but reads
+* straight from the packet buffer and throws SerializationException instead of silently
+* leaving fields unset when the packet is truncated.
+*/
+class BinaryReader {
+public:
+    BinaryReader(const unsigned char* data, int length)
+        : data_{data}
+        , length_{length > 0 ? static_cast<size_t>(length) : 0} {}
+
+    BinaryReader& read(char* dest, size_t length) {
+        Require(length);
+
+        if (length > 0) {
+            std::memcpy(dest, data_ + position_, length);
+            position_ += length;
+        }
+
+        return *this;
+    }
+
+    void seekg(size_t position) {
+        if (position > length_) {
+            throw SerializationException{"seek to " + std::to_string(position)
+                + " past the end of a " + std::to_string(length_) + " byte packet"};
+        }
+
+        position_ = position;
+    }
+
+    size_t tellg() const { return position_; }
+    size_t remaining() const { return length_ - position_; }
+
+    void Require(size_t length) const {
+        if (length > remaining()) {
+            throw SerializationException{"read of " + std::to_string(length) + " bytes at offset "
+                + std::to_string(position_) + " past the end of a " + std::to_string(length_)
+                + " byte packet"};
+        }
+    }
+
+private:
+    const unsigned char* data_;
+    size_t length_;
+    size_t position_ = 0;
+};
+
+// The length prefixes come from the wire, so they are checked against the bytes actually
+// left in the packet before anything is allocated for them.
+
+inline void read(BinaryReader& reader, std::string& value) {
+    uint16_t length;
+    reader.read(reinterpret_cast<char*>(&length), sizeof(length));
+    reader.Require(length);
+
+    value.resize(length);
+    reader.read(&value[0], length);
+}
+
+inline void read(BinaryReader& reader, std::u16string& value) {
+    static_assert(sizeof(char16_t) == sizeof(uint16_t), "char16_t must be 16 bits wide");
+
+    uint32_t length;
+    reader.read(reinterpret_cast<char*>(&length), sizeof(length));
+    reader.Require(static_cast<size_t>(length) * sizeof(uint16_t));
+
+    value.resize(length);
+    reader.read(reinterpret_cast<char*>(&value[0]), length * sizeof(uint16_t));
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+/** Growable byte buffer accepted by every write(StreamT&, ...) overload.
+*
+* It mirrors the std::ostream::write interface used by Serialization.hpp without the
+* virtual stream machinery. clear() keeps the allocated capacity, so a writer that is
+* reused for every message stops allocating once it has grown to the largest message.
+*/
+class BinaryWriter {
+public:
+    BinaryWriter() = default;
+    explicit BinaryWriter(size_t sizeHint) { buffer_.reserve(sizeHint); }
+
+    BinaryWriter& write(const char* data, size_t length) {
+        buffer_.insert(std::end(buffer_), data, data + length);
+        return *this;
+    }
+
+    void reserve(size_t sizeHint) { buffer_.reserve(sizeHint); }
+    void clear() { buffer_.clear(); }
+
+    char* data() { return buffer_.data(); }
+    const char* data() const { return buffer_.data(); }
+    size_t size() const { return buffer_.size(); }
+    size_t capacity() const { return buffer_.capacity(); }
+
+private:
+    std::vector<char> buffer_;
+};
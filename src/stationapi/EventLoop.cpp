@@ -0,0 +1,122 @@
+#include "EventLoop.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+void SetNonBlocking(int descriptor) {
+    int flags = fcntl(descriptor, F_GETFL, 0);
+    if (flags < 0 || fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw std::runtime_error{std::string{"event loop fcntl failed: "} + std::strerror(errno)};
+    }
+}
+
+} // namespace
+
+EventLoop::EventLoop() {
+    int descriptors[2];
+    if (pipe(descriptors) != 0) {
+        throw std::runtime_error{std::string{"event loop pipe failed: "} + std::strerror(errno)};
+    }
+
+    wakeRead_ = descriptors[0];
+    wakeWrite_ = descriptors[1];
+
+    SetNonBlocking(wakeRead_);
+    SetNonBlocking(wakeWrite_);
+}
+
+EventLoop::~EventLoop() {
+    close(wakeRead_);
+    close(wakeWrite_);
+}
+
+void EventLoop::Watch(int descriptor) {
+    if (descriptor >= 0) {
+        descriptors_.push_back(descriptor);
+    }
+}
+
+void EventLoop::AddTimer(std::chrono::milliseconds interval, std::function<void()> callback) {
+    timers_.push_back(Timer{Clock::now() + interval, interval, std::move(callback)});
+}
+
+void EventLoop::Wake() {
+    if (wakePending_.exchange(true)) {
+        return;
+    }
+
+    const char byte = 0;
+    // A full pipe already wakes the loop, so a failed write needs no handling.
+    auto written = write(wakeWrite_, &byte, 1);
+    (void)written;
+}
+
+bool EventLoop::Wait(std::chrono::milliseconds maxWait) {
+    auto timeout = maxWait;
+
+    auto now = Clock::now();
+    for (const auto& timer : timers_) {
+        auto untilDue = std::chrono::duration_cast<std::chrono::milliseconds>(timer.due - now);
+        if (timer.due > now && untilDue < timer.due - now) {
+            // Rounded up so a timer a fraction of a millisecond away is not spun on.
+            ++untilDue;
+        }
+
+        timeout = std::min(timeout, std::max(untilDue, std::chrono::milliseconds{0}));
+    }
+
+    std::vector<pollfd> polled;
+    polled.reserve(descriptors_.size() + 1);
+    polled.push_back(pollfd{wakeRead_, POLLIN, 0});
+    for (auto descriptor : descriptors_) {
+        polled.push_back(pollfd{descriptor, POLLIN, 0});
+    }
+
+    bool ready = false;
+    int count = poll(polled.data(), polled.size(), static_cast<int>(timeout.count()));
+
+    if (count > 0) {
+        if (polled[0].revents & POLLIN) {
+            char drain[64];
+            wakePending_ = false;
+            while (read(wakeRead_, drain, sizeof(drain)) > 0) {
+            }
+
+            ready = true;
+        }
+
+        for (size_t i = 1; i < polled.size(); ++i) {
+            if (polled[i].revents != 0) {
+                ready = true;
+            }
+        }
+    } else if (count < 0 && errno != EINTR) {
+        throw std::runtime_error{std::string{"event loop poll failed: "} + std::strerror(errno)};
+    }
+
+    RunDueTimers();
+
+    return ready;
+}
+
+void EventLoop::RunDueTimers() {
+    auto now = Clock::now();
+
+    for (auto& timer : timers_) {
+        if (timer.due <= now) {
+            // Rescheduled from now rather than from the missed deadline, so a stalled loop
+            // does not run a timer several times in a row to catch up.
+            timer.due = now + timer.interval;
+            timer.callback();
+        }
+    }
+}
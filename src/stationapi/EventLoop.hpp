@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+/** Blocks the tick thread until there is something for it to do.
+*
+* Wait returns as soon as a watched descriptor, such as a node's UDP socket, is readable or
+* Wake is called from any thread, and otherwise sleeps until the next timer is due. Timers run
+* on the thread calling Wait.
+*/
+class EventLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /** Negative descriptors are ignored, so callers need not check for an unexposed socket. */
+    void Watch(int descriptor);
+
+    /** Runs callback every interval, the first time one interval from now. */
+    void AddTimer(std::chrono::milliseconds interval, std::function<void()> callback);
+
+    /** Makes the current or next Wait return; safe to call from any thread. */
+    void Wake();
+
+    /** Waits at most maxWait for a readable descriptor, a wake or a due timer, then runs the
+    * timers that are due. Returns true if a descriptor was readable or Wake was called; a
+    * zero maxWait only checks.
+    */
+    bool Wait(std::chrono::milliseconds maxWait);
+
+private:
+    struct Timer {
+        Clock::time_point due;
+        std::chrono::milliseconds interval;
+        std::function<void()> callback;
+    };
+
+    void RunDueTimers();
+
+    int wakeRead_ = -1;
+    int wakeWrite_ = -1;
+    // Set while a wake byte is in the pipe, so repeated wakes do not fill it.
+    std::atomic<bool> wakePending_{false};
+    std::vector<int> descriptors_;
+    std::vector<Timer> timers_;
+};
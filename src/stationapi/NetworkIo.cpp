@@ -0,0 +1,200 @@
+#include "NetworkIo.hpp"
+#include "StreamUtils.hpp"
+
+#include "easylogging++.h"
+
+namespace {
+// How often an idle I/O thread still gives the udplibrary time for resends and timeouts.
+const std::chrono::milliseconds kWatchedWaitLimit{10};
+// Matches the old main loop when the socket cannot be watched.
+const std::chrono::milliseconds kUnwatchedWaitLimit{1};
+} // namespace
+
+NetworkIo::NetworkIo(UdpManager* manager, int socketHandle, size_t queueCapacity)
+    : manager_{manager}
+    , inbound_{queueCapacity}
+    , outbound_{queueCapacity}
+    , waitLimit_{socketHandle >= 0 ? kWatchedWaitLimit : kUnwatchedWaitLimit} {
+    loop_.Watch(socketHandle);
+}
+
+NetworkIo::~NetworkIo() { Stop(); }
+
+void NetworkIo::Start() {
+    thread_ = std::thread{&NetworkIo::Run, this};
+}
+
+void NetworkIo::Stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+
+    stopping_ = true;
+    loop_.Wake();
+    thread_.join();
+}
+
+bool NetworkIo::Service() {
+    bool busy = false;
+
+    manager_->GiveTime();
+
+    for (auto& connection : connections_) {
+        if (!connection.second && connection.first->GetStatus() == UdpConnection::cStatusDisconnected) {
+            connection.second = true;
+            PushControlEvent(NetworkEvent{NetworkEvent::Type::Disconnected, connection.first, {}});
+        }
+    }
+
+    // Taken before the ring is drained, so every packet queued ahead of a close is sent first.
+    std::vector<UdpConnection*> closes;
+    {
+        std::lock_guard<std::mutex> lock{controlMutex_};
+        closes.swap(closes_);
+    }
+
+    OutboundPacket packet;
+    while (outbound_.TryPop(packet)) {
+        busy = true;
+
+        logNetworkMessage(packet.connection, "Message To ->",
+            reinterpret_cast<const unsigned char*>(packet.data.data()),
+            static_cast<int>(packet.data.size()));
+        packet.connection->Send(
+            cUdpChannelReliable1, packet.data.data(), static_cast<int>(packet.data.size()));
+    }
+
+    for (auto* connection : closes) {
+        busy = true;
+        connection->SetHandler(nullptr);
+        connection->Disconnect();
+        connection->Release();
+        connections_.erase(connection);
+    }
+
+    if (queuedEvents_) {
+        busy = true;
+        queuedEvents_ = false;
+        NotifyEvents();
+    }
+
+    return busy;
+}
+
+void NetworkIo::Accept(UdpConnection* connection) {
+    connection->AddRef();
+    connection->SetHandler(this);
+    connections_.emplace(connection, false);
+
+    PushControlEvent(NetworkEvent{NetworkEvent::Type::Connected, connection, {}});
+}
+
+bool NetworkIo::PopEvent(NetworkEvent& event) {
+    if (!holdingPacket_) {
+        holdingPacket_ = inbound_.TryPop(heldPacket_);
+    }
+
+    {
+        // A connection event raised before the held packet is visible here, since the packet
+        // was queued after it.
+        std::lock_guard<std::mutex> lock{controlMutex_};
+        if (!inboundControl_.empty()
+            && (!holdingPacket_ || inboundControl_.front().sequence < heldPacket_.sequence)) {
+            event = std::move(inboundControl_.front());
+            inboundControl_.pop_front();
+            return true;
+        }
+    }
+
+    if (!holdingPacket_) {
+        return false;
+    }
+
+    event = std::move(heldPacket_);
+    holdingPacket_ = false;
+    return true;
+}
+
+void NetworkIo::Send(UdpConnection* connection, const char* data, uint32_t length) {
+    OutboundPacket packet;
+    packet.connection = connection;
+    packet.data.assign(data, data + length);
+
+    if (!outbound_.TryPush(std::move(packet))) {
+        ++outboundDropped_;
+        return;
+    }
+
+    loop_.Wake();
+}
+
+void NetworkIo::Close(UdpConnection* connection) {
+    {
+        std::lock_guard<std::mutex> lock{controlMutex_};
+        closes_.push_back(connection);
+    }
+
+    loop_.Wake();
+}
+
+void NetworkIo::SetEventHandler(std::function<void()> handler) {
+    std::lock_guard<std::mutex> lock{handlerMutex_};
+    eventHandler_ = std::move(handler);
+}
+
+NetworkIoStats NetworkIo::GetStats() const {
+    NetworkIoStats stats;
+    stats.capacity = inbound_.Capacity();
+    stats.inboundDepth = inbound_.Size();
+    stats.outboundDepth = outbound_.Size();
+    stats.inboundDropped = inboundDropped_;
+    stats.outboundDropped = outboundDropped_;
+    return stats;
+}
+
+void NetworkIo::OnRoutePacket(UdpConnection* connection, const uchar* data, int length) {
+    logNetworkMessage(connection, "Message From <-", data, length);
+
+    PushPacket(NetworkEvent{
+        NetworkEvent::Type::Packet, connection, std::vector<unsigned char>(data, data + length)});
+}
+
+void NetworkIo::NotifyEvents() {
+    std::lock_guard<std::mutex> lock{handlerMutex_};
+    if (eventHandler_) {
+        eventHandler_();
+    }
+}
+
+void NetworkIo::PushPacket(NetworkEvent event) {
+    event.sequence = nextSequence_++;
+
+    if (!inbound_.TryPush(std::move(event))) {
+        ++inboundDropped_;
+        return;
+    }
+
+    queuedEvents_ = true;
+}
+
+void NetworkIo::PushControlEvent(NetworkEvent event) {
+    event.sequence = nextSequence_++;
+
+    {
+        std::lock_guard<std::mutex> lock{controlMutex_};
+        inboundControl_.push_back(std::move(event));
+    }
+
+    queuedEvents_ = true;
+}
+
+void NetworkIo::Run() {
+    while (!stopping_) {
+        if (!Service()) {
+            loop_.Wait(waitLimit_);
+        }
+    }
+
+    // Closes queued by the node while it shut down.
+    Service();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "EventLoop.hpp"
+#include "SpscRing.hpp"
+#include "UdpLibrary.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct NetworkIoOptions {
+    // Pumps the udplibrary on a thread of its own; otherwise the node's Tick does it.
+    bool enabled = false;
+    // Packets each ring holds before further packets are dropped.
+    size_t queueCapacity = 8192;
+};
+
+struct NetworkIoStats {
+    size_t capacity = 0;
+    size_t inboundDepth = 0;
+    size_t outboundDepth = 0;
+    uint64_t inboundDropped = 0;
+    uint64_t outboundDropped = 0;
+};
+
+/** Something that happened on a connection, handed from the I/O thread to the node. */
+struct NetworkEvent {
+    enum class Type {
+        Connected,
+        Packet,
+        Disconnected
+    };
+
+    Type type = Type::Packet;
+    UdpConnection* connection = nullptr;
+    std::vector<unsigned char> data;
+    // Order in which the I/O thread raised the event, across packets and connection changes.
+    uint64_t sequence = 0;
+};
+
+/** Owns every udplibrary call for a node once it runs its I/O on a separate thread.
+*
+* The I/O thread gives the UdpManager time, routes received packets into the inbound ring and
+* sends what the node's thread put in the outbound ring, so reliable-channel resends and acks
+* keep flowing while a handler blocks. Each ring has one producer and one consumer. A packet
+* that finds its ring full is dropped and counted. Connection changes and closes must not be
+* lost, so they bypass the rings through unbounded mutex-guarded queues; neither thread ever
+* waits for the other to make room.
+*/
+class NetworkIo : public UdpConnectionHandler {
+public:
+    NetworkIo(UdpManager* manager, int socketHandle, size_t queueCapacity);
+    ~NetworkIo();
+
+    NetworkIo(const NetworkIo&) = delete;
+    NetworkIo& operator=(const NetworkIo&) = delete;
+
+    void Start();
+
+    /** Sends what is still queued, then joins the I/O thread. */
+    void Stop();
+
+    /** One pass of the I/O thread; returns false if there was nothing to do. */
+    bool Service();
+
+    // Called on the I/O thread.
+
+    /** Takes a reference to a new connection and routes its packets through the rings. */
+    void Accept(UdpConnection* connection);
+
+    // Called on the node's thread.
+
+    bool PopEvent(NetworkEvent& event);
+    void Send(UdpConnection* connection, const char* data, uint32_t length);
+    /** Disconnects and releases the connection on the I/O thread. */
+    void Close(UdpConnection* connection);
+
+    /** Called on the I/O thread after it queues events, e.g. to wake the node's thread. */
+    void SetEventHandler(std::function<void()> handler);
+
+    NetworkIoStats GetStats() const;
+
+private:
+    struct OutboundPacket {
+        UdpConnection* connection = nullptr;
+        std::vector<char> data;
+    };
+
+    void OnRoutePacket(UdpConnection* connection, const uchar* data, int length) override;
+
+    void NotifyEvents();
+    void PushPacket(NetworkEvent event);
+    void PushControlEvent(NetworkEvent event);
+    void Run();
+
+    UdpManager* manager_;
+    SpscRing<NetworkEvent> inbound_;
+    SpscRing<OutboundPacket> outbound_;
+    EventLoop loop_;
+    std::chrono::milliseconds waitLimit_;
+
+    std::mutex handlerMutex_;
+    std::function<void()> eventHandler_;
+
+    // Connection events for the node and connections it closed, in the order they were raised.
+    mutable std::mutex controlMutex_;
+    std::deque<NetworkEvent> inboundControl_;
+    std::vector<UdpConnection*> closes_;
+
+    // I/O thread only: accepted connections and whether their disconnect was reported.
+    std::unordered_map<UdpConnection*, bool> connections_;
+    uint64_t nextSequence_ = 0;
+    bool queuedEvents_ = false;
+
+    // Node's thread only: a packet taken from the ring while an older connection event may
+    // still be waiting in inboundControl_.
+    NetworkEvent heldPacket_;
+    bool holdingPacket_ = false;
+
+    std::atomic<uint64_t> inboundDropped_{0};
+    std::atomic<uint64_t> outboundDropped_{0};
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
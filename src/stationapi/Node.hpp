@@ -1,21 +1,43 @@
 
 #pragma once
 
+#include "NetworkIo.hpp"
+#include "NodeClient.hpp"
 #include "UdpLibrary.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <functional>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <stdexcept>
 
+namespace detail {
+
+// udplibrary builds that do not expose their socket report -1, which leaves an EventLoop to
+// fall back on its wait limit for noticing traffic.
+template <typename ManagerT>
+auto SocketHandleOf(ManagerT* manager, int) -> decltype(static_cast<int>(manager->GetSocketHandle())) {
+    return static_cast<int>(manager->GetSocketHandle());
+}
+
+template <typename ManagerT>
+int SocketHandleOf(ManagerT*, long) {
+    return -1;
+}
+
+} // namespace detail
+
 template <typename NodeT, typename ClientT>
 class Node : public UdpManagerHandler
 {
 public:
-    explicit Node(NodeT *node, const std::string &listenAddress, uint16_t listenPort, bool bindToIp = false)
+    explicit Node(NodeT *node, const std::string &listenAddress, uint16_t listenPort, bool bindToIp = false,
+        NetworkIoOptions ioOptions = {})
         : node_{node}
     {
 
@@ -34,34 +56,129 @@ public:
         }
 
         udpManager_ = new UdpManager(&params);
+
+        if (ioOptions.enabled)
+        {
+            networkIo_ = std::make_unique<NetworkIo>(udpManager_, GetSocketHandle(), ioOptions.queueCapacity);
+            networkIo_->Start();
+        }
     }
 
-    virtual ~Node() { udpManager_->Release(); }
+    virtual ~Node()
+    {
+        // Clients flush their batches into outboundStats_ and close their connections, so they
+        // go first; with an I/O thread both are queued and sent before it exits.
+        clients_.clear();
+
+        if (networkIo_)
+            networkIo_->Stop();
+
+        udpManager_->Release();
+    }
+
+    /** Null unless the node pumps the udplibrary on its own I/O thread. */
+    NetworkIo *GetNetworkIo() { return networkIo_.get(); }
+
+    /** The listening UDP socket, or -1 if the udplibrary does not expose it. */
+    int GetSocketHandle() const { return detail::SocketHandleOf(udpManager_, 0); }
 
     void Tick()
     {
-        udpManager_->GiveTime();
+        if (networkIo_)
+        {
+            DispatchNetworkEvents();
+        }
+        else
+        {
+            udpManager_->GiveTime();
+        }
+
+        auto remove_iter = std::stable_partition(std::begin(clients_), std::end(clients_), [](auto &client)
+                                                 { return !client->IsDisconnected(); });
 
-        auto remove_iter = std::remove_if(std::begin(clients_), std::end(clients_), [](auto &client)
-                                          { return client->GetConnection()->GetStatus() == UdpConnection::cStatusDisconnected; });
+        for (auto iter = remove_iter; iter != std::end(clients_); ++iter)
+            clientsByConnection_.erase((*iter)->GetConnection());
 
         if (remove_iter != std::end(clients_))
             clients_.erase(remove_iter, clients_.end());
 
         OnTick();
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto &client : clients_)
+        {
+            if (client->IsBatching() && client->HasBatchOlderThan(coalesceWindow_, now))
+                client->FlushBatch();
+        }
     }
 
+    /** Sends what batching clients gathered; called once the node has nothing left to do. */
+    void FlushOutbound()
+    {
+        for (auto &client : clients_)
+            client->FlushBatch();
+    }
+
+    /** How long a batching client may hold a message while ticks follow each other back to
+    * back; zero sends each tick's messages at the end of the tick.
+    */
+    void SetCoalesceWindow(std::chrono::microseconds window) { coalesceWindow_ = window; }
+
+    const OutboundStats &GetOutboundStats() const { return outboundStats_; }
+
 private:
     virtual void OnTick() = 0;
 
     void OnConnectRequest(UdpConnection *connection) override
     {
+        if (networkIo_)
+        {
+            // On the I/O thread; the client is created when the node's thread sees the event.
+            networkIo_->Accept(connection);
+            return;
+        }
+
         AddClient(std::make_unique<ClientT>(connection, node_));
     }
 
-    void AddClient(std::unique_ptr<ClientT> client) { clients_.push_back(std::move(client)); }
+    void AddClient(std::unique_ptr<ClientT> client)
+    {
+        client->SetOutboundStats(&outboundStats_);
+
+        if (networkIo_)
+            clientsByConnection_[client->GetConnection()] = client.get();
+
+        clients_.push_back(std::move(client));
+    }
+
+    void DispatchNetworkEvents()
+    {
+        NetworkEvent event;
+        while (networkIo_->PopEvent(event))
+        {
+            if (event.type == NetworkEvent::Type::Connected)
+            {
+                AddClient(std::make_unique<ClientT>(event.connection, node_));
+                continue;
+            }
+
+            auto find_iter = clientsByConnection_.find(event.connection);
+            if (find_iter == std::end(clientsByConnection_))
+                continue;
+
+            if (event.type == NetworkEvent::Type::Packet)
+                find_iter->second->HandlePacket(event.data.data(), static_cast<int>(event.data.size()));
+            else
+                find_iter->second->MarkDisconnected();
+        }
+    }
 
     std::vector<std::unique_ptr<ClientT>> clients_;
+    // Routes events from the I/O thread; only kept when there is one.
+    std::unordered_map<UdpConnection *, ClientT *> clientsByConnection_;
     NodeT *node_;
     UdpManager *udpManager_;
+    std::unique_ptr<NetworkIo> networkIo_;
+    std::chrono::microseconds coalesceWindow_{0};
+    OutboundStats outboundStats_;
 };
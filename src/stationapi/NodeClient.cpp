@@ -1,30 +1,153 @@
 
 #include "NodeClient.hpp"
+#include "NetworkIo.hpp"
+#include "Serialization.hpp"
 #include "StreamUtils.hpp"
 
-NodeClient::NodeClient(UdpConnection* connection)
-    : connection_{connection}
-    , ostream_{std::stringstream::out | std::stringstream::binary}
-    , istream_{std::stringstream::in | std::stringstream::binary} {
-    connection_->AddRef();
+#include "easylogging++.h"
+
+#include <cstring>
+
+namespace {
+// Large enough for typical responses so the reused writer rarely has to grow.
+const size_t kInitialWriterCapacity = 512;
+// The marker and the message count.
+const size_t kBatchHeaderSize = sizeof(uint16_t) + sizeof(uint16_t);
+
+/** Lets write() fill in bytes already reserved in a frame, such as its message count. */
+class FramePatch {
+public:
+    explicit FramePatch(char* at)
+        : at_{at} {}
+
+    FramePatch& write(const char* data, size_t length) {
+        std::memcpy(at_, data, length);
+        at_ += length;
+        return *this;
+    }
+
+private:
+    char* at_;
+};
+}
+
+const uint16_t NodeClient::kBatchFrameMarker;
+const size_t NodeClient::kMaxBatchBytes;
+
+NodeClient::NodeClient(UdpConnection* connection, NetworkIo* networkIo)
+    : writer_{kInitialWriterCapacity}
+    , connection_{connection}
+    , networkIo_{networkIo} {
+    // NetworkIo already holds a reference and routes the packets.
+    if (!networkIo_) {
+        connection_->AddRef();
+        connection_->SetHandler(this);
+    }
 }
 
 NodeClient::~NodeClient() {
+    // Messages still gathered for the peer go out ahead of the disconnect.
+    FlushBatch();
+
+    if (networkIo_) {
+        networkIo_->Close(connection_);
+        return;
+    }
+
     connection_->SetHandler(nullptr);
     connection_->Disconnect();
     connection_->Release();
 }
 
 void NodeClient::Send(const char* data, uint32_t length) {
+    if (!batching_) {
+        SendPacket(data, length, 1);
+        return;
+    }
+
+    auto framedLength = sizeof(uint32_t) + length;
+
+    if (kBatchHeaderSize + framedLength > kMaxBatchBytes) {
+        // Flushed first so the peer still sees messages in the order they were sent.
+        FlushBatch();
+        SendPacket(data, length, 1);
+        return;
+    }
+
+    if (batch_.size() + framedLength > kMaxBatchBytes || batchCount_ == UINT16_MAX) {
+        FlushBatch();
+    }
+
+    if (batchCount_ == 0) {
+        batchStartedAt_ = std::chrono::steady_clock::now();
+        write(batch_, kBatchFrameMarker);
+        write(batch_, batchCount_);
+    }
+
+    write(batch_, length);
+    batch_.write(data, length);
+    ++batchCount_;
+}
+
+void NodeClient::FlushBatch() {
+    if (batchCount_ == 1) {
+        // A lone message gains nothing from the frame.
+        auto offset = kBatchHeaderSize + sizeof(uint32_t);
+        SendPacket(batch_.data() + offset, static_cast<uint32_t>(batch_.size() - offset), 1);
+    } else if (batchCount_ > 1) {
+        FramePatch count{batch_.data() + sizeof(uint16_t)};
+        write(count, batchCount_);
+        SendPacket(batch_.data(), static_cast<uint32_t>(batch_.size()), batchCount_);
+    }
+
+    batch_.clear();
+    batchCount_ = 0;
+}
+
+bool NodeClient::HasBatchOlderThan(
+    std::chrono::microseconds age, std::chrono::steady_clock::time_point now) const {
+    return batchCount_ > 0 && now - batchStartedAt_ >= age;
+}
+
+void NodeClient::SendPacket(const char* data, uint32_t length, uint32_t messages) {
+    if (outboundStats_) {
+        ++outboundStats_->packets;
+        outboundStats_->messages += messages;
+        if (messages > 1) {
+            ++outboundStats_->batchFrames;
+        }
+    }
+
+    if (networkIo_) {
+        networkIo_->Send(connection_, data, length);
+        return;
+    }
+
     logNetworkMessage(
         connection_, "Message To ->", reinterpret_cast<const unsigned char*>(data), length);
     connection_->Send(cUdpChannelReliable1, data, length);
 }
 
+bool NodeClient::IsDisconnected() const {
+    if (networkIo_) {
+        return disconnected_;
+    }
+
+    return connection_->GetStatus() == UdpConnection::cStatusDisconnected;
+}
+
 void NodeClient::OnRoutePacket(UdpConnection* connection, const uchar* data, int length) {
     logNetworkMessage(connection, "Message From <-", data, length);
 
-    istream_.clear();
-    istream_.str({reinterpret_cast<const char*>(data), static_cast<uint32_t>(length)});
-    OnIncoming(istream_);
+    HandlePacket(data, length);
+}
+
+void NodeClient::HandlePacket(const uchar* data, int length) {
+    BinaryReader reader{data, length};
+
+    try {
+        OnIncoming(reader);
+    } catch (const SerializationException& e) {
+        LOG(ERROR) << "Dropping malformed message: " << e.what();
+    }
 }
@@ -1,35 +1,101 @@
 
 #pragma once
 
+#include "BinaryReader.hpp"
+#include "BinaryWriter.hpp"
 #include "UdpLibrary.hpp"
 
-#include <sstream>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+
+class NetworkIo;
+
+struct OutboundStats {
+    uint64_t packets = 0;
+    uint64_t messages = 0;
+    // Packets that carried a batch frame of more than one message.
+    uint64_t batchFrames = 0;
+};
 
 class NodeClient : public UdpConnectionHandler {
 public:
-    explicit NodeClient(UdpConnection* connection);
+    /** With a NetworkIo the client never calls into the udplibrary itself: packets arrive
+    * through HandlePacket and sends are queued for the I/O thread.
+    */
+    explicit NodeClient(UdpConnection* connection, NetworkIo* networkIo = nullptr);
 
     virtual ~NodeClient();
 
+    /** Starts a packet that carries several messages: the marker, a uint16 message count, then
+    * each message as a uint32 length followed by its bytes. No message type uses the marker.
+    */
+    static const uint16_t kBatchFrameMarker = 0xFFFF;
+    /** Batches are sent once they would grow past this; a larger message goes out alone. */
+    static const size_t kMaxBatchBytes = 1200;
+
     template <typename T>
     void Send(const T& message) {
-        ostream_.clear();
-        ostream_.str("");
-        write(ostream_, message);
-        auto data = ostream_.str();
-        Send(data.c_str(), data.length());
+        writer_.clear();
+        write(writer_, message);
+        Send(writer_.data(), static_cast<uint32_t>(writer_.size()));
     }
 
+    /** Sends an already serialized message, e.g. one encoded once for several clients. */
+    void Send(const char* data, uint32_t length);
+
     UdpConnection* GetConnection() { return connection_; }
 
-private:
-    void Send(const char* data, uint32_t length);
+    /** From now on gathers messages into batch frames until FlushBatch; only for a peer that
+    * negotiated them, which must accept a frame from the negotiation response on.
+    */
+    void EnableBatching() { batching_ = true; }
+    bool IsBatching() const { return batching_; }
+
+    /** Sends the gathered messages, as a batch frame if there is more than one. */
+    void FlushBatch();
+    bool HasBatchOlderThan(std::chrono::microseconds age, std::chrono::steady_clock::time_point now) const;
 
-    virtual void OnIncoming(std::istringstream& istream) = 0;
+    /** Counts every packet this client sends; the node shares one across its clients. */
+    void SetOutboundStats(OutboundStats* stats) { outboundStats_ = stats; }
+
+    void HandlePacket(const uchar* data, int length);
+
+    bool IsDisconnected() const;
+    /** Records a disconnect reported by the I/O thread. */
+    void MarkDisconnected() { disconnected_ = true; }
+
+private:
+    virtual void OnIncoming(BinaryReader& reader) = 0;
 
     void OnRoutePacket(UdpConnection* connection, const uchar* data, int length) override;
 
-    std::ostringstream ostream_;
-    std::istringstream istream_;
+    void SendPacket(const char* data, uint32_t length, uint32_t messages);
+
+    BinaryWriter writer_;
+    BinaryWriter batch_;
+    uint16_t batchCount_ = 0;
+    std::chrono::steady_clock::time_point batchStartedAt_;
+    bool batching_ = false;
+    OutboundStats* outboundStats_ = nullptr;
     UdpConnection* connection_;
+    NetworkIo* networkIo_;
+    bool disconnected_ = false;
 };
+
+/** Serializes message into writer once and sends the same bytes to the client each key maps
+* to in clients, skipping keys without one.
+*/
+template <typename ClientMapT, typename KeyRangeT, typename MessageT>
+void SendToEach(BinaryWriter& writer, const ClientMapT& clients, const KeyRangeT& keys,
+    const MessageT& message) {
+    writer.clear();
+    write(writer, message);
+
+    for (const auto& key : keys) {
+        auto find_iter = clients.find(key);
+        if (find_iter != std::end(clients)) {
+            find_iter->second->Send(writer.data(), static_cast<uint32_t>(writer.size()));
+        }
+    }
+}
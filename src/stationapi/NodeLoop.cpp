@@ -0,0 +1,76 @@
+#include "NodeLoop.hpp"
+
+#include "easylogging++.h"
+
+#include <algorithm>
+
+namespace {
+// The old fixed sleep, kept for udplibrary builds whose sockets cannot be watched.
+const std::chrono::milliseconds kUnwatchedWaitLimit{1};
+const std::chrono::milliseconds kWatchedWaitLimit{1000};
+} // namespace
+
+NodeLoop::NodeLoop(std::string name, std::function<void()> tick, NodeLoopOptions options)
+    : name_{std::move(name)}
+    , tick_{std::move(tick)}
+    , options_{options}
+    , waitLimit_{kWatchedWaitLimit} {
+    options_.maxBatch = std::max(options_.maxBatch, 1u);
+    options_.housekeepingInterval =
+        std::max(options_.housekeepingInterval, std::chrono::milliseconds{1});
+
+    eventLoop_.AddTimer(options_.housekeepingInterval, [this]() { tick_(); });
+}
+
+NodeLoop::~NodeLoop() { Stop(); }
+
+void NodeLoop::Watch(int descriptor) {
+    if (descriptor < 0) {
+        LOG(WARNING) << name_ << ": udplibrary does not expose its socket; polling for traffic every "
+                     << kUnwatchedWaitLimit.count() << "ms";
+        waitLimit_ = kUnwatchedWaitLimit;
+        return;
+    }
+
+    eventLoop_.Watch(descriptor);
+}
+
+void NodeLoop::Start() {
+    stopping_ = false;
+    thread_ = std::thread{&NodeLoop::Run, this};
+}
+
+void NodeLoop::Stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+
+    stopping_ = true;
+    eventLoop_.Wake();
+    thread_.join();
+}
+
+void NodeLoop::Run() {
+    LOG(INFO) << name_ << " loop started";
+
+    while (!stopping_) {
+        if (eventLoop_.Wait(waitLimit_)) {
+            // Keeps draining a burst while more arrives, but gives the timers a turn after
+            // maxBatch passes.
+            for (uint32_t pass = 0; pass < options_.maxBatch && !stopping_; ++pass) {
+                tick_();
+
+                if (!eventLoop_.Wait(std::chrono::milliseconds{0})) {
+                    break;
+                }
+            }
+        }
+
+        // Also after a housekeeping tick, which runs inside Wait.
+        if (idle_) {
+            idle_();
+        }
+    }
+
+    LOG(INFO) << name_ << " loop stopped";
+}
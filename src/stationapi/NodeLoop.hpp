@@ -0,0 +1,65 @@
+#pragma once
+
+#include "EventLoop.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+struct NodeLoopOptions {
+    // Back to back ticks while traffic keeps arriving before the timers get a turn.
+    uint32_t maxBatch = 32;
+    // How often the node is ticked while idle, for udplibrary resends and timeouts.
+    std::chrono::milliseconds housekeepingInterval{50};
+};
+
+/** Ticks one node on a thread of its own whenever its event loop has something for it.
+*
+* Everything the node does, from handling packets to running database continuations, happens
+* on this thread, so a busy node does not hold up the others. Register what should wake the
+* loop before Start.
+*/
+class NodeLoop {
+public:
+    NodeLoop(std::string name, std::function<void()> tick, NodeLoopOptions options = {});
+    ~NodeLoop();
+
+    NodeLoop(const NodeLoop&) = delete;
+    NodeLoop& operator=(const NodeLoop&) = delete;
+
+    /** Wakes the loop when the descriptor is readable. A negative one means the node's socket
+    * cannot be watched, and the loop falls back to polling for traffic every millisecond.
+    */
+    void Watch(int descriptor);
+
+    /** Safe to call from any thread. */
+    void Wake() { eventLoop_.Wake(); }
+
+    /** Called on the loop thread each time a run of ticks ends and the loop goes back to
+    * waiting, e.g. to send what was held back while traffic kept arriving.
+    */
+    void SetIdleHandler(std::function<void()> handler) { idle_ = std::move(handler); }
+
+    void Start();
+
+    /** Lets the tick in progress finish, then joins the thread. */
+    void Stop();
+
+    bool IsRunning() const { return thread_.joinable(); }
+
+private:
+    void Run();
+
+    std::string name_;
+    std::function<void()> tick_;
+    std::function<void()> idle_;
+    NodeLoopOptions options_;
+    EventLoop eventLoop_;
+    // Longest sleep between checks for traffic; short only if a socket could not be watched.
+    std::chrono::milliseconds waitLimit_;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
@@ -71,27 +71,24 @@ void write(StreamT& ostream, const std::string& value) {
 
 template <typename StreamT>
 void read(StreamT& istream, std::u16string& value) {
+    static_assert(sizeof(char16_t) == sizeof(uint16_t), "char16_t must be 16 bits wide");
+
     uint32_t length;
     read(istream, length);
 
     value.resize(length);
-    uint16_t tmp;
-    for (uint32_t i = 0; i < length; ++i) {
-        istream.read(reinterpret_cast<char*>(&tmp), sizeof(uint16_t));
-        value[i] = tmp;
-    }
+    istream.read(reinterpret_cast<char*>(&value[0]), length * sizeof(uint16_t));
 }
 
 template <typename StreamT>
 void write(StreamT& ostream, const std::u16string& value) {
+    static_assert(sizeof(char16_t) == sizeof(uint16_t), "char16_t must be 16 bits wide");
+
     uint32_t length = static_cast<uint32_t>(value.length());
     write(ostream, length);
 
-    uint16_t tmp;
-    for (uint32_t i = 0; i < length; ++i) {
-        tmp = static_cast<uint16_t>(value[i]);
-        ostream.write(reinterpret_cast<const char*>(&tmp), sizeof(uint16_t));
-    }
+    // char16_t code units share the wire layout of uint16_t, so the payload is one copy.
+    ostream.write(reinterpret_cast<const char*>(value.data()), length * sizeof(uint16_t));
 }
 
 // Specialized Read Types
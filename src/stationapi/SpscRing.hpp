@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/** Bounded lock-free queue between exactly one producer thread and one consumer thread.
+*
+* The capacity is rounded up to a power of two. TryPush leaves its argument untouched when the
+* ring is full, so the caller decides whether to drop or retry.
+*/
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : slots_(RoundUpToPowerOfTwo(capacity))
+        , mask_{slots_.size() - 1} {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    bool TryPush(T&& value) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+            return false;
+        }
+
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& value) {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Approximate when called while the other thread is pushing or popping. */
+    size_t Size() const {
+        auto head = head_.load(std::memory_order_acquire);
+        return tail_.load(std::memory_order_acquire) - head;
+    }
+
+    size_t Capacity() const { return slots_.size(); }
+
+private:
+    static size_t RoundUpToPowerOfTwo(size_t value) {
+        size_t rounded = 1;
+        while (rounded < value) {
+            rounded <<= 1;
+        }
+        return rounded;
+    }
+
+    std::vector<T> slots_;
+    const size_t mask_;
+    // Kept on separate cache lines so the two threads do not contend for one.
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+/** Set of avatars used for room membership and role lists.
+*
+* Members are kept in insertion order for serialization, while a sorted array of their ids
+* answers Contains with a binary search over contiguous memory instead of dereferencing each
+* avatar. Every member holds a cache reference on its avatar for as long as it is in the set.
+*/
+template <typename AvatarPtrT>
+class AvatarIdSet {
+public:
+    using const_iterator = typename std::vector<AvatarPtrT>::const_iterator;
+
+    AvatarIdSet() = default;
+    ~AvatarIdSet() { Clear(); }
+
+    AvatarIdSet(const AvatarIdSet&) = delete;
+    AvatarIdSet& operator=(const AvatarIdSet&) = delete;
+
+    AvatarIdSet& operator=(std::initializer_list<AvatarPtrT> avatars) {
+        Clear();
+
+        for (auto avatar : avatars) {
+            Insert(avatar);
+        }
+
+        return *this;
+    }
+
+    bool Contains(uint32_t avatarId) const {
+        return std::binary_search(std::begin(sortedIds_), std::end(sortedIds_), avatarId);
+    }
+
+    /** Adds the avatar unless an avatar with the same id is already present. */
+    bool Insert(AvatarPtrT avatar) {
+        auto avatarId = avatar->GetAvatarId();
+        auto position = std::lower_bound(std::begin(sortedIds_), std::end(sortedIds_), avatarId);
+        if (position != std::end(sortedIds_) && *position == avatarId) {
+            return false;
+        }
+
+        sortedIds_.insert(position, avatarId);
+        orderedIds_.push_back(avatarId);
+        avatars_.push_back(avatar);
+        avatar->AddReference();
+
+        return true;
+    }
+
+    bool Erase(uint32_t avatarId) {
+        auto position = std::lower_bound(std::begin(sortedIds_), std::end(sortedIds_), avatarId);
+        if (position == std::end(sortedIds_) || *position != avatarId) {
+            return false;
+        }
+
+        sortedIds_.erase(position);
+
+        auto index = std::distance(std::begin(orderedIds_),
+            std::find(std::begin(orderedIds_), std::end(orderedIds_), avatarId));
+        avatars_[index]->RemoveReference();
+
+        orderedIds_.erase(std::begin(orderedIds_) + index);
+        avatars_.erase(std::begin(avatars_) + index);
+
+        return true;
+    }
+
+    void Clear() {
+        for (auto avatar : avatars_) {
+            avatar->RemoveReference();
+        }
+
+        sortedIds_.clear();
+        orderedIds_.clear();
+        avatars_.clear();
+    }
+
+    const std::vector<AvatarPtrT>& Avatars() const { return avatars_; }
+
+    size_t size() const { return avatars_.size(); }
+    bool empty() const { return avatars_.empty(); }
+    AvatarPtrT operator[](size_t index) const { return avatars_[index]; }
+    const_iterator begin() const { return std::begin(avatars_); }
+    const_iterator end() const { return std::end(avatars_); }
+
+private:
+    std::vector<uint32_t> sortedIds_;
+    // Parallel to avatars_ so removal finds its slot without touching the avatars themselves.
+    std::vector<uint32_t> orderedIds_;
+    std::vector<AvatarPtrT> avatars_;
+};
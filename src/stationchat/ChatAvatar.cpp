@@ -4,6 +4,12 @@
 
 #include <algorithm>
 
+FriendContact::FriendContact(const ChatAvatar* frnd, const std::u16string& comment_)
+    : FriendContact{frnd->GetAvatarId(), frnd->GetName(), frnd->GetAddress(), comment_} {}
+
+IgnoreContact::IgnoreContact(const ChatAvatar* ignored)
+    : IgnoreContact{ignored->GetAvatarId(), ignored->GetName(), ignored->GetAddress()} {}
+
 ChatAvatar::ChatAvatar(ChatAvatarService * avatarService)
     : avatarService_{avatarService} {}
 
@@ -23,13 +29,20 @@ void ChatAvatar::AddFriend(ChatAvatar* avatar, const std::u16string& comment) {
     if (IsIgnored(avatar)) RemoveIgnore(avatar);
 
     friendList_.push_back(FriendContact{avatar, comment});
+    avatarService_->IndexFriend(avatarId_, avatar->avatarId_);
 
     avatarService_->PersistFriend(avatarId_, avatar->avatarId_, comment);
 }
 
 void ChatAvatar::RemoveFriend(const ChatAvatar* avatar) {
-    auto del_iter = std::remove_if(std::begin(friendList_), std::end(friendList_),
-        [avatar](auto& frnd) { return frnd.frnd->GetAvatarId() == avatar->GetAvatarId(); });
+    auto del_iter = std::remove_if(std::begin(friendList_), std::end(friendList_), [this, avatar](auto& frnd) {
+        if (frnd.avatarId != avatar->GetAvatarId()) {
+            return false;
+        }
+
+        avatarService_->UnindexFriend(avatarId_, avatar->avatarId_);
+        return true;
+    });
 
     if (del_iter != std::end(friendList_)) {
         friendList_.erase(del_iter, std::end(friendList_));
@@ -40,7 +53,7 @@ void ChatAvatar::RemoveFriend(const ChatAvatar* avatar) {
 
 void ChatAvatar::UpdateFriendComment(const ChatAvatar* avatar, const std::u16string& comment) {
     auto find_iter = std::find_if(std::begin(friendList_), std::end(friendList_),
-        [avatar](auto& frnd) { return frnd.frnd->GetAvatarId() == avatar->GetAvatarId(); });
+        [avatar](auto& frnd) { return frnd.avatarId == avatar->GetAvatarId(); });
 
     if (find_iter != std::end(friendList_)) {
         find_iter->comment = comment;
@@ -50,7 +63,7 @@ void ChatAvatar::UpdateFriendComment(const ChatAvatar* avatar, const std::u16str
 
 bool ChatAvatar::IsFriend(const ChatAvatar* avatar) {
     auto find_iter = std::find_if(std::begin(friendList_), std::end(friendList_),
-        [avatar](auto& frnd) { return frnd.frnd->GetAvatarId() == avatar->GetAvatarId(); });
+        [avatar](auto& frnd) { return frnd.avatarId == avatar->GetAvatarId(); });
 
     if (find_iter != std::end(friendList_)) {
         return true;
@@ -70,7 +83,7 @@ void ChatAvatar::AddIgnore(ChatAvatar* avatar) {
 
 void ChatAvatar::RemoveIgnore(const ChatAvatar* avatar) {
     auto del_iter = std::remove_if(std::begin(ignoreList_), std::end(ignoreList_),
-        [avatar](auto& ignored) { return ignored.ignored->GetAvatarId() == avatar->GetAvatarId(); });
+        [avatar](auto& ignored) { return ignored.avatarId == avatar->GetAvatarId(); });
 
     if (del_iter != std::end(ignoreList_)) {
         ignoreList_.erase(del_iter, std::end(ignoreList_));
@@ -79,9 +92,13 @@ void ChatAvatar::RemoveIgnore(const ChatAvatar* avatar) {
     }
 }
 
+bool ChatAvatar::IsContactOnline(uint32_t avatarId) const {
+    return avatarService_->GetOnlineAvatar(avatarId) != nullptr;
+}
+
 bool ChatAvatar::IsIgnored(const ChatAvatar* avatar) {
     auto find_iter = std::find_if(std::begin(ignoreList_), std::end(ignoreList_),
-                                  [avatar](auto& ignored) { return ignored.ignored->GetAvatarId() == avatar->GetAvatarId(); });
+                                  [avatar](auto& ignored) { return ignored.avatarId == avatar->GetAvatarId(); });
 
     if (find_iter != std::end(ignoreList_)) {
         return true;
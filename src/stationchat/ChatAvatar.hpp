@@ -19,20 +19,41 @@ enum class AvatarAttribute : uint32_t {
     EXTENDED = 1 << 4
 };
 
+/** Friend and ignore entries are stubs holding the contact's id and display name; the
+* contact's own ChatAvatar is only resolved (e.g. for presence) when it is needed, so loading
+* an avatar never pulls in the avatars on its lists.
+*/
 struct FriendContact {
-    FriendContact(const ChatAvatar* frnd_, const std::u16string& comment_)
-            : frnd{frnd_}
+    FriendContact(uint32_t avatarId_, const std::u16string& name_, const std::u16string& address_,
+        const std::u16string& comment_)
+            : avatarId{avatarId_}
+            , name{name_}
+            , address{address_}
             , comment{comment_} {}
+    FriendContact(const ChatAvatar* frnd, const std::u16string& comment_);
 
-    const ChatAvatar* frnd;
+    uint32_t avatarId;
+    std::u16string name;
+    std::u16string address;
     std::u16string comment = u"";
 };
 
 struct IgnoreContact {
-    IgnoreContact(const ChatAvatar* ignored_)
-            : ignored{ignored_} {}
+    IgnoreContact(uint32_t avatarId_, const std::u16string& name_, const std::u16string& address_)
+            : avatarId{avatarId_}
+            , name{name_}
+            , address{address_} {}
+    IgnoreContact(const ChatAvatar* ignored);
+
+    uint32_t avatarId;
+    std::u16string name;
+    std::u16string address;
+};
 
-    const ChatAvatar* ignored;
+/** A friend contact paired with the presence resolved for it when a friend list is sent. */
+struct FriendContactStatus {
+    const FriendContact& contact;
+    bool online;
 };
 
 class ChatAvatar {
@@ -67,16 +88,34 @@ public:
     void UpdateFriendComment(const ChatAvatar* avatar, const std::u16string& comment);
     bool IsFriend(const ChatAvatar* avatar);
 
-    const std::vector<FriendContact> GetFriendList() const { return friendList_; }
+    const std::vector<FriendContact>& GetFriendList() const { return friendList_; }
+
+    /** Resolves a contact's presence from the online avatars without loading the contact. */
+    bool IsContactOnline(uint32_t avatarId) const;
 
     void AddIgnore(ChatAvatar* avatar);
     void RemoveIgnore(const ChatAvatar* avatar);
     bool IsIgnored(const ChatAvatar* avatar);
 
-    const std::vector<IgnoreContact> GetIgnoreList() const { return ignoreList_; }
+    const std::vector<IgnoreContact>& GetIgnoreList() const { return ignoreList_; }
+
+    /** Rooms this avatar is currently in; maintained by ChatRoom as avatars enter and leave. */
+    const std::vector<ChatRoom*>& GetJoinedRooms() const { return rooms_; }
+
+    /** Rooms holding a pointer to this avatar take a reference so the avatar cache never
+    * evicts an object that is still in use.
+    */
+    void AddReference() const { ++references_; }
+    void RemoveReference() const {
+        if (references_ > 0) {
+            --references_;
+        }
+    }
+    bool IsReferenced() const { return references_ > 0; }
 
 private:
     friend class ChatAvatarService;
+    friend class ChatRoom;
 
     ChatAvatarService* avatarService_;
 
@@ -94,6 +133,7 @@ private:
     uint32_t inboxLimit_ = 0;
     std::u16string statusMessage_ = u"";
     bool isOnline_ = false;
+    mutable uint32_t references_ = 0;
 
     std::vector<FriendContact> friendList_;
     std::vector<IgnoreContact> ignoreList_;
@@ -117,15 +157,15 @@ void write(StreamT& ar, const ChatAvatar* data) {
 
 
 template <typename StreamT>
-void write(StreamT& ar, const FriendContact& data) {
-    write(ar, data.frnd->GetName());
-    write(ar, data.frnd->GetAddress());
-    write(ar, data.comment);
-    write(ar, static_cast<short>(data.frnd->IsOnline() ? 1 : 0));
+void write(StreamT& ar, const FriendContactStatus& data) {
+    write(ar, data.contact.name);
+    write(ar, data.contact.address);
+    write(ar, data.contact.comment);
+    write(ar, static_cast<short>(data.online ? 1 : 0));
 }
 
 template <typename StreamT>
 void write(StreamT& ar, const IgnoreContact& data) {
-    write(ar, data.ignored->GetName());
-    write(ar, data.ignored->GetAddress());
+    write(ar, data.name);
+    write(ar, data.address);
 }
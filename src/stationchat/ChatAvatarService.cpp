@@ -1,26 +1,75 @@
 #include "ChatAvatarService.hpp"
 #include "ChatAvatar.hpp"
 #include "Database.hpp"
+#include "PersistenceQueue.hpp"
 #include "StringUtils.hpp"
 
 #include <easylogging++.h>
 
-ChatAvatarService::ChatAvatarService(IDatabaseConnection* db)
-    : db_{db} {}
+#include <algorithm>
+
+namespace {
+// Bounds the work done by a single EvictAvatars call when the cold end of the cache is
+// dominated by pinned avatars.
+const size_t kMaxEvictionScan = 1024;
+
+enum class HydrationRow : int {
+    AVATAR = 0,
+    FRIEND = 1,
+    IGNORE = 2
+};
+
+// Fetches an avatar row followed by its friend and ignore rows, each contact joined to its
+// own avatar row for the display name, in a single round trip. ownerPredicate selects the
+// avatar being loaded through the alias "o".
+std::string BuildHydrationSql(const std::string& ignoreTable, const std::string& ownerPredicate) {
+    return "SELECT 0 AS row_kind, o.id, o.user_id, o.name, o.address, o.attributes, '' AS comment "
+           "FROM avatar o WHERE " + ownerPredicate +
+           " UNION ALL "
+           "SELECT 1, f.friend_avatar_id, 0, c.name, c.address, 0, f.comment FROM avatar o "
+           "INNER JOIN friend f ON f.avatar_id = o.id "
+           "INNER JOIN avatar c ON c.id = f.friend_avatar_id WHERE " + ownerPredicate +
+           " UNION ALL "
+           "SELECT 2, i.ignore_avatar_id, 0, c.name, c.address, 0, '' FROM avatar o "
+           "INNER JOIN " + ignoreTable + " i ON i.avatar_id = o.id "
+           "INNER JOIN avatar c ON c.id = i.ignore_avatar_id WHERE " + ownerPredicate +
+           " ORDER BY row_kind";
+}
+
+// Contact list writes are queued under the owner's scope; a friend and its comment share a key
+// so that queued changes to the same contact can be coalesced.
+std::string AvatarScope(uint32_t avatarId) {
+    return "avatar:" + std::to_string(avatarId);
+}
+
+std::string FriendKey(uint32_t srcAvatarId, uint32_t destAvatarId) {
+    return "friend:" + std::to_string(srcAvatarId) + ":" + std::to_string(destAvatarId);
+}
+
+std::string IgnoreKey(uint32_t srcAvatarId, uint32_t destAvatarId) {
+    return "ignore:" + std::to_string(srcAvatarId) + ":" + std::to_string(destAvatarId);
+}
+} // namespace
+
+ChatAvatarService::ChatAvatarService(
+    IDatabaseConnection* db, size_t cacheCapacity, PersistenceQueue* persistenceQueue)
+    : cacheCapacity_{cacheCapacity}
+    , db_{db}
+    , persistenceQueue_{persistenceQueue} {}
 
 ChatAvatarService::~ChatAvatarService() {}
 
 ChatAvatar* ChatAvatarService::GetAvatar(const std::u16string& name, const std::u16string& address) {
     ChatAvatar* avatar = GetCachedAvatar(name, address);
 
-    if (!avatar) {
-        auto loadedAvatar = LoadStoredAvatar(name, address);
-        if (loadedAvatar != nullptr) {
-            avatar = loadedAvatar.get();
-            avatarCache_.emplace_back(std::move(loadedAvatar));
+    if (avatar) {
+        ++cacheStats_.hits;
+    } else {
+        ++cacheStats_.misses;
 
-            LoadFriendList(avatar);
-            LoadIgnoreList(avatar);
+        auto loadedAvatar = LoadStoredAvatar(*db_, name, address);
+        if (loadedAvatar != nullptr) {
+            avatar = CacheLoadedAvatar(std::move(loadedAvatar));
         }
     }
 
@@ -30,31 +79,50 @@ ChatAvatar* ChatAvatarService::GetAvatar(const std::u16string& name, const std::
 ChatAvatar* ChatAvatarService::GetAvatar(uint32_t avatarId) {
     ChatAvatar* avatar = GetCachedAvatar(avatarId);
 
-    if (!avatar) {
-        auto loadedAvatar = LoadStoredAvatar(avatarId);
-        if (loadedAvatar != nullptr) {
-            avatar = loadedAvatar.get();
-            avatarCache_.emplace_back(std::move(loadedAvatar));
+    if (avatar) {
+        ++cacheStats_.hits;
+    } else {
+        ++cacheStats_.misses;
 
-            LoadFriendList(avatar);
-            LoadIgnoreList(avatar);
+        auto loadedAvatar = LoadStoredAvatar(*db_, avatarId);
+        if (loadedAvatar != nullptr) {
+            avatar = CacheLoadedAvatar(std::move(loadedAvatar));
         }
     }
 
     return avatar;
 }
 
+ChatAvatar* ChatAvatarService::FindCachedAvatar(
+    const std::u16string& name, const std::u16string& address) {
+    ChatAvatar* avatar = GetCachedAvatar(name, address);
+
+    if (avatar) {
+        ++cacheStats_.hits;
+    }
+
+    return avatar;
+}
+
+ChatAvatar* ChatAvatarService::AdoptLoadedAvatar(std::unique_ptr<ChatAvatar> loadedAvatar) {
+    ++cacheStats_.misses;
+
+    if (!loadedAvatar) {
+        return nullptr;
+    }
+
+    auto cachedAvatar = GetCachedAvatar(loadedAvatar->avatarId_);
+    return cachedAvatar ? cachedAvatar : CacheLoadedAvatar(std::move(loadedAvatar));
+}
+
 ChatAvatar* ChatAvatarService::CreateAvatar(const std::u16string& name, const std::u16string& address,
     uint32_t userId, uint32_t loginAttributes, const std::u16string& loginLocation) {
     auto tmp
         = std::make_unique<ChatAvatar>(this, name, address, userId, loginAttributes, loginLocation);
-    auto avatar = tmp.get();
-
-    InsertAvatar(avatar);
 
-    avatarCache_.emplace_back(std::move(tmp));
+    InsertAvatar(tmp.get());
 
-    return avatar;
+    return CacheAvatar(std::move(tmp));
 }
 
 void ChatAvatarService::DestroyAvatar(ChatAvatar* avatar) {
@@ -65,173 +133,259 @@ void ChatAvatarService::DestroyAvatar(ChatAvatar* avatar) {
 
 void ChatAvatarService::LoginAvatar(ChatAvatar* avatar) {
     avatar->isOnline_ = true;
-
-    if (!IsOnline(avatar)) {
-        onlineAvatars_.push_back(avatar);
-    }
+    onlineAvatars_[avatar->avatarId_] = avatar;
 }
 
 void ChatAvatarService::LogoutAvatar(ChatAvatar* avatar) {
 	if(!avatar->isOnline_) return;
     avatar->isOnline_ = false;
 
-    auto newEnd = std::remove_if(
-        std::begin(onlineAvatars_), std::end(onlineAvatars_), [avatar](auto onlineAvatar) {
-            return onlineAvatar->GetAvatarId() == avatar->GetAvatarId();
-        });
-    onlineAvatars_.erase(newEnd, std::end(onlineAvatars_));
+    onlineAvatars_.erase(avatar->avatarId_);
+}
+
+ChatAvatar* ChatAvatarService::GetOnlineAvatar(uint32_t avatarId) const {
+    auto find_iter = onlineAvatars_.find(avatarId);
+    return find_iter != std::end(onlineAvatars_) ? find_iter->second : nullptr;
+}
+
+std::vector<ChatAvatar*> ChatAvatarService::GetOnlineAvatarsWithFriend(uint32_t avatarId) const {
+    std::vector<ChatAvatar*> owners;
+
+    auto find_iter = friendOwners_.find(avatarId);
+    if (find_iter == std::end(friendOwners_)) {
+        return owners;
+    }
+
+    for (auto ownerId : find_iter->second) {
+        auto online_iter = onlineAvatars_.find(ownerId);
+        if (online_iter != std::end(onlineAvatars_)) {
+            owners.push_back(online_iter->second);
+        }
+    }
+
+    return owners;
 }
 
 void ChatAvatarService::PersistAvatar(const ChatAvatar* avatar) { UpdateAvatar(avatar); }
 
 void ChatAvatarService::PersistFriend(
     uint32_t srcAvatarId, uint32_t destAvatarId, const std::u16string& comment) {
-        char sql[] = "INSERT INTO friend (avatar_id, friend_avatar_id, comment) VALUES (@avatar_id, "
-                 "@friend_avatar_id, @comment)";
+    PersistenceOp op{PersistenceOpKind::Insert,
+        "INSERT INTO friend (avatar_id, friend_avatar_id, comment) VALUES (@avatar_id, "
+        "@friend_avatar_id, @comment)",
+        {}, FriendKey(srcAvatarId, destAvatarId), AvatarScope(srcAvatarId)};
 
-    StatementHandle stmt{db_->Prepare(sql)};
+    op.BindInt("@avatar_id", srcAvatarId)
+        .BindInt("@friend_avatar_id", destAvatarId)
+        .BindText("@comment", FromWideString(comment));
 
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-    int friendAvatarIdIdx = stmt->BindParameterIndex("@friend_avatar_id");
-    int commentIdx = stmt->BindParameterIndex("@comment");
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
+}
 
-    std::string commentStr = FromWideString(comment);
+void ChatAvatarService::PersistIgnore(uint32_t srcAvatarId, uint32_t destAvatarId) {
+    PersistenceOp op{PersistenceOpKind::Insert,
+        "INSERT INTO " + IgnoreTableIdentifier(*db_)
+            + " (avatar_id, ignore_avatar_id) VALUES (@avatar_id, @ignore_avatar_id)",
+        {}, IgnoreKey(srcAvatarId, destAvatarId), AvatarScope(srcAvatarId)};
 
-    stmt->BindInt(avatarIdIdx, srcAvatarId);
-    stmt->BindInt(friendAvatarIdIdx, destAvatarId);
-    stmt->BindText(commentIdx, commentStr);
+    op.BindInt("@avatar_id", srcAvatarId).BindInt("@ignore_avatar_id", destAvatarId);
 
-    stmt.ExpectDone();
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 }
 
-void ChatAvatarService::PersistIgnore(uint32_t srcAvatarId, uint32_t destAvatarId) {
-        auto sql = "INSERT INTO " + IgnoreTableIdentifier(*db_)
-        + " (avatar_id, ignore_avatar_id) VALUES (@avatar_id, @ignore_avatar_id)";
+void ChatAvatarService::RemoveFriend(uint32_t srcAvatarId, uint32_t destAvatarId) {
+    PersistenceOp op{PersistenceOpKind::Delete,
+        "DELETE FROM friend WHERE avatar_id = @avatar_id AND friend_avatar_id = "
+        "@friend_avatar_id",
+        {}, FriendKey(srcAvatarId, destAvatarId), AvatarScope(srcAvatarId)};
 
-    StatementHandle stmt{db_->Prepare(sql)};
+    op.BindInt("@avatar_id", srcAvatarId).BindInt("@friend_avatar_id", destAvatarId);
 
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-    int ignoreAvatarIdIdx = stmt->BindParameterIndex("@ignore_avatar_id");
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
+}
 
-    stmt->BindInt(avatarIdIdx, srcAvatarId);
-    stmt->BindInt(ignoreAvatarIdIdx, destAvatarId);
+void ChatAvatarService::RemoveIgnore(uint32_t srcAvatarId, uint32_t destAvatarId) {
+    PersistenceOp op{PersistenceOpKind::Delete,
+        "DELETE FROM " + IgnoreTableIdentifier(*db_)
+            + " WHERE avatar_id = @avatar_id AND ignore_avatar_id = @ignore_avatar_id",
+        {}, IgnoreKey(srcAvatarId, destAvatarId), AvatarScope(srcAvatarId)};
 
-    stmt.ExpectDone();
+    op.BindInt("@avatar_id", srcAvatarId).BindInt("@ignore_avatar_id", destAvatarId);
+
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 }
 
-void ChatAvatarService::RemoveFriend(uint32_t srcAvatarId, uint32_t destAvatarId) {
-    
-    char sql[] = "DELETE FROM friend WHERE avatar_id = @avatar_id AND friend_avatar_id = "
-                 "@friend_avatar_id";
+void ChatAvatarService::UpdateFriendComment(
+    uint32_t srcAvatarId, uint32_t destAvatarId, const std::u16string& comment) {
+    PersistenceOp op{PersistenceOpKind::Update,
+        "UPDATE friend SET comment = @comment WHERE avatar_id = @avatar_id AND "
+        "friend_avatar_id = @friend_avatar_id",
+        {}, FriendKey(srcAvatarId, destAvatarId), AvatarScope(srcAvatarId)};
 
-    StatementHandle stmt{db_->Prepare(sql)};
+    op.BindText("@comment", FromWideString(comment))
+        .BindInt("@avatar_id", srcAvatarId)
+        .BindInt("@friend_avatar_id", destAvatarId);
 
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-    int friendAvatarIdIdx = stmt->BindParameterIndex("@friend_avatar_id");
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
+}
 
-    stmt->BindInt(avatarIdIdx, srcAvatarId);
-    stmt->BindInt(friendAvatarIdIdx, destAvatarId);
+size_t ChatAvatarService::AvatarNameKeyHash::operator()(const AvatarNameKey& key) const {
+    std::hash<std::u16string> hasher;
+    size_t seed = hasher(key.name);
+    seed ^= hasher(key.address) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    return seed;
+}
 
-    stmt.ExpectDone();
+ChatAvatar* ChatAvatarService::GetCachedAvatar(
+    const std::u16string& name, const std::u16string& address) {
+    auto find_iter = avatarsByName_.find(AvatarNameKey{name, address});
+    return find_iter != std::end(avatarsByName_) ? GetCachedAvatar(find_iter->second->avatarId_)
+                                                 : nullptr;
 }
 
-void ChatAvatarService::RemoveIgnore(uint32_t srcAvatarId, uint32_t destAvatarId) {
-    
-    auto sql = "DELETE FROM " + IgnoreTableIdentifier(*db_)
-        + " WHERE avatar_id = @avatar_id AND ignore_avatar_id = @ignore_avatar_id";
+ChatAvatar* ChatAvatarService::GetCachedAvatar(uint32_t avatarId) {
+    auto find_iter = avatarCache_.find(avatarId);
+    if (find_iter == std::end(avatarCache_)) {
+        return nullptr;
+    }
 
-    StatementHandle stmt{db_->Prepare(sql)};
+    TouchCachedAvatar(find_iter->second);
+    return find_iter->second.avatar.get();
+}
 
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-    int ignoreAvatarIdIdx = stmt->BindParameterIndex("@ignore_avatar_id");
+ChatAvatar* ChatAvatarService::CacheAvatar(std::unique_ptr<ChatAvatar> avatar) {
+    auto cachedAvatar = avatar.get();
 
-    stmt->BindInt(avatarIdIdx, srcAvatarId);
-    stmt->BindInt(ignoreAvatarIdIdx, destAvatarId);
+    RemoveCachedAvatar(cachedAvatar->avatarId_);
 
-    stmt.ExpectDone();
+    lruOrder_.push_front(cachedAvatar->avatarId_);
+    avatarsByName_[AvatarNameKey{cachedAvatar->name_, cachedAvatar->address_}] = cachedAvatar;
+    avatarCache_[cachedAvatar->avatarId_] =
+        CachedAvatar{std::move(avatar), std::begin(lruOrder_), ++useClock_, false};
+
+    return cachedAvatar;
 }
 
-void ChatAvatarService::UpdateFriendComment(
-    uint32_t srcAvatarId, uint32_t destAvatarId, const std::u16string& comment) {
-        char sql[] = "UPDATE friend SET comment = @comment WHERE avatar_id = @avatar_id AND "
-                 "friend_avatar_id = @friend_avatar_id";
+ChatAvatar* ChatAvatarService::CacheLoadedAvatar(std::unique_ptr<ChatAvatar> avatar) {
+    auto cachedAvatar = CacheAvatar(std::move(avatar));
 
-    StatementHandle stmt{db_->Prepare(sql)};
+    for (auto& friendContact : cachedAvatar->friendList_) {
+        IndexFriend(cachedAvatar->avatarId_, friendContact.avatarId);
+    }
 
-    int commentIdx = stmt->BindParameterIndex("@comment");
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-    int friendAvatarIdIdx = stmt->BindParameterIndex("@friend_avatar_id");
+    return cachedAvatar;
+}
+
+void ChatAvatarService::TouchCachedAvatar(CachedAvatar& entry) {
+    lruOrder_.splice(
+        std::begin(lruOrder_), entry.parked ? parkedAvatars_ : lruOrder_, entry.lruPosition);
+    entry.lastUsed = ++useClock_;
+    entry.parked = false;
+}
+
+void ChatAvatarService::RemoveCachedAvatar(uint32_t avatarId) {
+    auto find_iter = avatarCache_.find(avatarId);
+    if (find_iter == std::end(avatarCache_)) {
+        return;
+    }
 
-    std::string commentStr = FromWideString(comment);
+    auto avatar = find_iter->second.avatar.get();
 
-    stmt->BindText(commentIdx, commentStr);
-    stmt->BindInt(avatarIdIdx, srcAvatarId);
-    stmt->BindInt(friendAvatarIdIdx, destAvatarId);
+    for (auto& friendContact : avatar->friendList_) {
+        UnindexFriend(avatarId, friendContact.avatarId);
+    }
 
-    stmt.ExpectDone();
+    avatarsByName_.erase(AvatarNameKey{avatar->name_, avatar->address_});
+    (find_iter->second.parked ? parkedAvatars_ : lruOrder_).erase(find_iter->second.lruPosition);
+    avatarCache_.erase(find_iter);
 }
 
-ChatAvatar* ChatAvatarService::GetCachedAvatar(
-    const std::u16string& name, const std::u16string& address) {
-    ChatAvatar* avatar = nullptr;
+void ChatAvatarService::EvictAvatars() {
+    if (cacheCapacity_ == 0) {
+        return;
+    }
 
-    // First look for the avatar in the cache
-    auto find_iter = std::find_if(
-        std::begin(avatarCache_), std::end(avatarCache_), [name, address](const auto& avatar) {
-            return avatar->name_.compare(name) == 0 && avatar->address_.compare(address) == 0;
-        });
+    if (avatarCache_.size() <= cacheCapacity_) {
+        return;
+    }
 
-    if (find_iter != std::end(avatarCache_)) {
-        avatar = find_iter->get();
+    std::unordered_set<std::string> pendingScopes;
+    if (persistenceQueue_) {
+        pendingScopes = persistenceQueue_->GetPendingScopes();
     }
 
-    return avatar;
-}
+    UnparkAvatars(pendingScopes);
 
-ChatAvatar* ChatAvatarService::GetCachedAvatar(uint32_t avatarId) {
-    ChatAvatar* avatar = nullptr;
+    size_t examined = 0;
+    while (avatarCache_.size() > cacheCapacity_ && !lruOrder_.empty()
+        && examined++ < kMaxEvictionScan) {
+        auto avatarId = lruOrder_.back();
+        auto& entry = avatarCache_[avatarId];
 
-    // First look for the avatar in the cache
-    auto find_iter = std::find_if(std::begin(avatarCache_), std::end(avatarCache_),
-        [avatarId](const auto& avatar) { return avatar->avatarId_ == avatarId; });
+        if (IsPinned(entry.avatar.get(), pendingScopes)) {
+            // Parked rather than moved up, so it keeps its true age for when it is unpinned.
+            parkedAvatars_.splice(
+                std::end(parkedAvatars_), lruOrder_, std::prev(std::end(lruOrder_)));
+            entry.parked = true;
+            continue;
+        }
 
-    if (find_iter != std::end(avatarCache_)) {
-        avatar = find_iter->get();
+        RemoveCachedAvatar(avatarId);
+        ++cacheStats_.evictions;
     }
+}
 
-    return avatar;
+bool ChatAvatarService::IsPinned(
+    const ChatAvatar* avatar, const std::unordered_set<std::string>& pendingScopes) const {
+    // An avatar with contact list writes still queued stays cached, since reloading it
+    // from storage before they land would lose them.
+    return avatar->IsOnline() || avatar->IsReferenced()
+        || (!pendingScopes.empty() && pendingScopes.count(AvatarScope(avatar->avatarId_)) > 0);
 }
 
-void ChatAvatarService::RemoveCachedAvatar(uint32_t avatarId) {
-    auto remove_iter = std::remove_if(std::begin(avatarCache_), std::end(avatarCache_),
-                                  [avatarId](const auto& avatar) { return avatar->avatarId_ == avatarId; });
+void ChatAvatarService::UnparkAvatars(const std::unordered_set<std::string>& pendingScopes) {
+    // Each call looks at a bounded slice, sending the still pinned to the back of the list.
+    auto remaining = std::min(parkedAvatars_.size(), kMaxEvictionScan);
+
+    while (remaining-- > 0) {
+        auto parked = std::begin(parkedAvatars_);
+        auto& entry = avatarCache_[*parked];
+
+        if (IsPinned(entry.avatar.get(), pendingScopes)) {
+            parkedAvatars_.splice(std::end(parkedAvatars_), parkedAvatars_, parked);
+            continue;
+        }
+
+        // Parked avatars have gone unused for a while, so their place is near the cold end.
+        auto position = std::end(lruOrder_);
+        while (position != std::begin(lruOrder_)
+            && avatarCache_[*std::prev(position)].lastUsed < entry.lastUsed) {
+            --position;
+        }
 
-    if (remove_iter != std::end(avatarCache_)) {
-        avatarCache_.erase(remove_iter, std::end(avatarCache_));
+        lruOrder_.splice(position, parkedAvatars_, parked);
+        entry.parked = false;
     }
 }
 
 void ChatAvatarService::RemoveAsFriendOrIgnoreFromAll(const ChatAvatar* avatar) {
     for (auto& cachedAvatar : avatarCache_) {
-        if (cachedAvatar->IsFriend(avatar)) {
-            cachedAvatar->RemoveFriend(avatar);
+        if (cachedAvatar.second.avatar->IsFriend(avatar)) {
+            cachedAvatar.second.avatar->RemoveFriend(avatar);
         }
 
-        if (cachedAvatar->IsIgnored(avatar)) {
-            cachedAvatar->RemoveIgnore(avatar);
+        if (cachedAvatar.second.avatar->IsIgnored(avatar)) {
+            cachedAvatar.second.avatar->RemoveIgnore(avatar);
         }
     }
 }
 
 std::unique_ptr<ChatAvatar> ChatAvatarService::LoadStoredAvatar(
-    const std::u16string& name, const std::u16string& address) {
-    std::unique_ptr<ChatAvatar> avatar{nullptr};
+    IDatabaseConnection& db, const std::u16string& name, const std::u16string& address) {
+    auto sql = BuildHydrationSql(
+        IgnoreTableIdentifier(db), "o.name = @name AND o.address = @address");
 
-    
-    char sql[] = "SELECT id, user_id, name, address, attributes FROM avatar WHERE name = @name AND "
-                 "address = @address";
-
-    StatementHandle stmt{db_->Prepare(sql)};
+    StatementHandle stmt{db.Prepare(sql)};
 
     std::string nameStr = FromWideString(name);
     std::string addressStr = FromWideString(address);
@@ -242,51 +396,48 @@ std::unique_ptr<ChatAvatar> ChatAvatarService::LoadStoredAvatar(
     stmt->BindText(nameIdx, nameStr);
     stmt->BindText(addressIdx, addressStr);
 
-    if (stmt->Step() == StatementStepResult::Row) {
-        avatar = std::make_unique<ChatAvatar>(this);
-        avatar->avatarId_ = stmt->ColumnInt(0);
-        avatar->userId_ = stmt->ColumnInt(1);
-
-        auto tmp = stmt->ColumnText(2);
-        avatar->name_ = std::u16string{std::begin(tmp), std::end(tmp)};
-
-        tmp = stmt->ColumnText(3);
-        avatar->address_ = std::u16string(std::begin(tmp), std::end(tmp));
-
-        avatar->attributes_ = stmt->ColumnInt(4);
-    }
-
-    
-    return avatar;
+    return ReadStoredAvatar(stmt);
 }
 
-std::unique_ptr<ChatAvatar> ChatAvatarService::LoadStoredAvatar(uint32_t avatarId) {
-    std::unique_ptr<ChatAvatar> avatar{nullptr};
+std::unique_ptr<ChatAvatar> ChatAvatarService::LoadStoredAvatar(
+    IDatabaseConnection& db, uint32_t avatarId) {
+    auto sql = BuildHydrationSql(IgnoreTableIdentifier(db), "o.id = @avatar_id");
 
-    
-    char sql[] = "SELECT id, user_id, name, address, attributes FROM avatar WHERE id = @avatar_id";
-
-    StatementHandle stmt{db_->Prepare(sql)};
+    StatementHandle stmt{db.Prepare(sql)};
 
     int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
 
     stmt->BindInt(avatarIdIdx, avatarId);
 
-    if (stmt->Step() == StatementStepResult::Row) {
-        avatar = std::make_unique<ChatAvatar>(this);
-        avatar->avatarId_ = stmt->ColumnInt(0);
-        avatar->userId_ = stmt->ColumnInt(1);
-
-        auto tmp = stmt->ColumnText(2);
-        avatar->name_ = std::u16string{std::begin(tmp), std::end(tmp)};
+    return ReadStoredAvatar(stmt);
+}
 
-        tmp = stmt->ColumnText(3);
-        avatar->address_ = std::u16string(std::begin(tmp), std::end(tmp));
+std::unique_ptr<ChatAvatar> ChatAvatarService::ReadStoredAvatar(StatementHandle& stmt) {
+    std::unique_ptr<ChatAvatar> avatar{nullptr};
 
-        avatar->attributes_ = stmt->ColumnInt(4);
+    while (stmt.Step() == StatementStepResult::Row) {
+        auto rowKind = static_cast<HydrationRow>(stmt->ColumnInt(0));
+        auto id = static_cast<uint32_t>(stmt->ColumnInt(1));
+        auto name = ToWideString(stmt->ColumnText(3));
+        auto address = ToWideString(stmt->ColumnText(4));
+
+        if (rowKind == HydrationRow::AVATAR) {
+            avatar = std::make_unique<ChatAvatar>(this);
+            avatar->avatarId_ = id;
+            avatar->userId_ = stmt->ColumnInt(2);
+            avatar->name_ = name;
+            avatar->address_ = address;
+            avatar->attributes_ = stmt->ColumnInt(5);
+        } else if (!avatar) {
+            // Contact rows sort after the avatar row; without one the avatar does not exist.
+            break;
+        } else if (rowKind == HydrationRow::FRIEND) {
+            avatar->friendList_.emplace_back(id, name, address, ToWideString(stmt->ColumnText(6)));
+        } else if (rowKind == HydrationRow::IGNORE) {
+            avatar->ignoreList_.emplace_back(id, name, address);
+        }
     }
 
-    
     return avatar;
 }
 
@@ -345,7 +496,13 @@ void ChatAvatarService::UpdateAvatar(const ChatAvatar* avatar) {
 
 void ChatAvatarService::DeleteAvatar(ChatAvatar* avatar) {
     CHECK_NOTNULL(avatar);
-    
+
+    // Queued contact writes may reference the avatar row, so they land before it goes away.
+    if (persistenceQueue_ && !persistenceQueue_->Flush(kPersistenceWaitTimeout)) {
+        throw DatabaseException{"timed out waiting for queued writes before deleting avatar "
+            + std::to_string(avatar->avatarId_)};
+    }
+
     char sql[] = "DELETE FROM avatar WHERE id = @avatar_id";
 
     StatementHandle stmt{db_->Prepare(sql)};
@@ -357,55 +514,18 @@ void ChatAvatarService::DeleteAvatar(ChatAvatar* avatar) {
     stmt.ExpectDone();
 }
 
-void ChatAvatarService::LoadFriendList(ChatAvatar* avatar) {
-    
-    char sql[] = "SELECT friend_avatar_id, comment FROM friend WHERE avatar_id = @avatar_id";
-
-    StatementHandle stmt{db_->Prepare(sql)};
-
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-
-    stmt->BindInt(avatarIdIdx, avatar->avatarId_);
-
-    uint32_t tmpFriendId;
-    std::string tmpComment;
-    while (stmt->Step() == StatementStepResult::Row) {
-        tmpFriendId = stmt->ColumnInt(0);
-        tmpComment = stmt->ColumnText(1);
-
-        auto friendAvatar = GetAvatar(tmpFriendId);
-
-        avatar->friendList_.emplace_back(friendAvatar, ToWideString(tmpComment));
-    }
+void ChatAvatarService::IndexFriend(uint32_t ownerId, uint32_t friendId) {
+    friendOwners_[friendId].insert(ownerId);
 }
 
-void ChatAvatarService::LoadIgnoreList(ChatAvatar* avatar) {
-    
-    auto sql = "SELECT ignore_avatar_id FROM " + IgnoreTableIdentifier(*db_)
-        + " WHERE avatar_id = @avatar_id";
-
-    StatementHandle stmt{db_->Prepare(sql)};
-
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-
-    stmt->BindInt(avatarIdIdx, avatar->avatarId_);
-
-    uint32_t tmpIgnoreId;
-    while (stmt->Step() == StatementStepResult::Row) {
-        tmpIgnoreId = stmt->ColumnInt(0);
-
-        auto ignoreAvatar = GetAvatar(tmpIgnoreId);
-
-        avatar->ignoreList_.emplace_back(ignoreAvatar);
+void ChatAvatarService::UnindexFriend(uint32_t ownerId, uint32_t friendId) {
+    auto find_iter = friendOwners_.find(friendId);
+    if (find_iter == std::end(friendOwners_)) {
+        return;
     }
-}
 
-bool ChatAvatarService::IsOnline(const ChatAvatar * avatar) const {
-    for (auto onlineAvatar : onlineAvatars_) {
-        if (onlineAvatar->GetAvatarId() == avatar->GetAvatarId()) {
-            return true;
-        }
+    find_iter->second.erase(ownerId);
+    if (find_iter->second.empty()) {
+        friendOwners_.erase(find_iter);
     }
-
-    return false;
 }
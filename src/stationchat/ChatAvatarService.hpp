@@ -6,20 +6,50 @@
 
 #include <boost/optional.hpp>
 
+#include <cstdint>
+#include <list>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 class IDatabaseConnection;
+class PersistenceQueue;
+class StatementHandle;
+
+struct AvatarCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
 
 class ChatAvatarService {
 public:
-    explicit ChatAvatarService(IDatabaseConnection* db);
+    /** A cacheCapacity of 0 disables eviction. Contact list writes go through persistenceQueue
+    * when one is given and are executed synchronously otherwise.
+    */
+    explicit ChatAvatarService(IDatabaseConnection* db, size_t cacheCapacity = 0,
+        PersistenceQueue* persistenceQueue = nullptr);
     ~ChatAvatarService();
     
     ChatAvatar* GetAvatar(const std::u16string& name, const std::u16string& address);
     ChatAvatar* GetAvatar(uint32_t avatarId);
 
+    /** Returns the avatar if it is cached, without touching storage; nullptr otherwise. */
+    ChatAvatar* FindCachedAvatar(const std::u16string& name, const std::u16string& address);
+
+    /** Reads an avatar and its contact lists from db without touching the cache, so it may
+    * run on a database worker. The result is handed back through AdoptLoadedAvatar.
+    */
+    std::unique_ptr<ChatAvatar> LoadStoredAvatar(
+        IDatabaseConnection& db, const std::u16string& name, const std::u16string& address);
+
+    /** Caches an avatar returned by LoadStoredAvatar. If the avatar was cached while it was
+    * being loaded, the cached copy wins and loadedAvatar is discarded.
+    */
+    ChatAvatar* AdoptLoadedAvatar(std::unique_ptr<ChatAvatar> loadedAvatar);
+
     ChatAvatar* CreateAvatar(const std::u16string& name,
                              const std::u16string& address, uint32_t userId, uint32_t loginAttributes,
                              const std::u16string& loginLocation);
@@ -38,28 +68,88 @@ public:
 
     void UpdateFriendComment(uint32_t srcAvatarId, uint32_t destAvatarId, const std::u16string& comment);
 
-    const std::vector<ChatAvatar*>& GetOnlineAvatars() const { return onlineAvatars_; }
-    
+    const std::unordered_map<uint32_t, ChatAvatar*>& GetOnlineAvatars() const { return onlineAvatars_; }
+
+    /** Returns the avatar if it is online, without touching storage; nullptr otherwise. */
+    ChatAvatar* GetOnlineAvatar(uint32_t avatarId) const;
+
+    /** Returns the online avatars that have the given avatar on their friend list. */
+    std::vector<ChatAvatar*> GetOnlineAvatarsWithFriend(uint32_t avatarId) const;
+
+    /** Evicts least recently used avatars that are offline and unreferenced until the cache
+    * is back within capacity. Handlers hold raw avatar pointers for the duration of a
+    * request, so this must only run between requests.
+    */
+    void EvictAvatars();
+
+    const AvatarCacheStats& GetCacheStats() const { return cacheStats_; }
+    size_t GetCachedAvatarCount() const { return avatarCache_.size(); }
+
 private:
+    friend class ChatAvatar;
+
+    struct AvatarNameKey {
+        std::u16string name;
+        std::u16string address;
+
+        bool operator==(const AvatarNameKey& other) const {
+            return name == other.name && address == other.address;
+        }
+    };
+
+    struct AvatarNameKeyHash {
+        size_t operator()(const AvatarNameKey& key) const;
+    };
+
+    struct CachedAvatar {
+        std::unique_ptr<ChatAvatar> avatar;
+        // Into lruOrder_, or into parkedAvatars_ while parked.
+        std::list<uint32_t>::iterator lruPosition;
+        // Use clock reading of the last lookup; orders a parked avatar when it returns.
+        uint64_t lastUsed;
+        bool parked;
+    };
+
     ChatAvatar* GetCachedAvatar(const std::u16string& name, const std::u16string& address);
     ChatAvatar* GetCachedAvatar(uint32_t avatarId);
 
+    ChatAvatar* CacheAvatar(std::unique_ptr<ChatAvatar> avatar);
+    ChatAvatar* CacheLoadedAvatar(std::unique_ptr<ChatAvatar> avatar);
+    void TouchCachedAvatar(CachedAvatar& entry);
     void RemoveCachedAvatar(uint32_t avatarId);
+    /** pendingScopes is a PersistenceQueue::GetPendingScopes snapshot; enqueues happen on
+    * this thread, so it can only be conservative while eviction runs.
+    */
+    bool IsPinned(
+        const ChatAvatar* avatar, const std::unordered_set<std::string>& pendingScopes) const;
+    /** Returns parked avatars that are no longer pinned to lruOrder_ at their last use. */
+    void UnparkAvatars(const std::unordered_set<std::string>& pendingScopes);
     void RemoveAsFriendOrIgnoreFromAll(const ChatAvatar* avatar);
     
-    std::unique_ptr<ChatAvatar> LoadStoredAvatar(const std::u16string& name, const std::u16string& address);
-    std::unique_ptr<ChatAvatar> LoadStoredAvatar(uint32_t avatarId);
+    std::unique_ptr<ChatAvatar> LoadStoredAvatar(IDatabaseConnection& db, uint32_t avatarId);
+    std::unique_ptr<ChatAvatar> ReadStoredAvatar(StatementHandle& stmt);
 
     void InsertAvatar(ChatAvatar* avatar);
     void UpdateAvatar(const ChatAvatar* avatar);
     void DeleteAvatar(ChatAvatar* avatar);
 
-    void LoadFriendList(ChatAvatar* avatar);
-    void LoadIgnoreList(ChatAvatar* avatar);
-
-    bool IsOnline(const ChatAvatar* avatar) const;
-
-    std::vector<std::unique_ptr<ChatAvatar>> avatarCache_;
-    std::vector<ChatAvatar*> onlineAvatars_;
+    void IndexFriend(uint32_t ownerId, uint32_t friendId);
+    void UnindexFriend(uint32_t ownerId, uint32_t friendId);
+
+    // avatarCache_ owns every cached avatar; avatarsByName_ and lruOrder_ (most recently used
+    // first) plus parkedAvatars_ index the same objects and must be updated alongside it.
+    std::unordered_map<uint32_t, CachedAvatar> avatarCache_;
+    std::unordered_map<AvatarNameKey, ChatAvatar*, AvatarNameKeyHash> avatarsByName_;
+    std::list<uint32_t> lruOrder_;
+    // Pinned avatars eviction ran into, kept out of lruOrder_ so they neither block it nor
+    // lose their place in it; unordered.
+    std::list<uint32_t> parkedAvatars_;
+    uint64_t useClock_ = 0;
+    size_t cacheCapacity_;
+    AvatarCacheStats cacheStats_;
+    std::unordered_map<uint32_t, ChatAvatar*> onlineAvatars_;
+    // Reverse friend index: friend id -> ids of the cached avatars listing it as a friend.
+    std::unordered_map<uint32_t, std::unordered_set<uint32_t>> friendOwners_;
     IDatabaseConnection* db_;
+    PersistenceQueue* persistenceQueue_;
 };
@@ -22,8 +22,14 @@ ChatRoom::ChatRoom(ChatRoomService* roomService, uint32_t roomId, const ChatAvat
     , creatorId_{creator->GetAvatarId()}
     , roomAttributes_{roomAttributes}
     , maxRoomSize_{maxRoomSize} {
-    administrators_.push_back(creator);
-    moderators_.push_back(creator);
+    administrators_.Insert(creator);
+    moderators_.Insert(creator);
+}
+
+ChatRoom::~ChatRoom() {
+    for (auto avatar : avatars_) {
+        RemoveJoinedRoom(avatar);
+    }
 }
 
 bool ChatRoom::IsPrivate() const {
@@ -63,28 +69,28 @@ void ChatRoom::EnterRoom(ChatAvatar* avatar, const std::u16string& password) {
         throw ChatResultException{ChatResultCode::ROOM_PRIVATEROOM};
     }
 
-    avatars_.push_back(avatar);
+    avatars_.Insert(avatar);
+    avatar->rooms_.push_back(this);
 }
 
 bool ChatRoom::IsInRoom(ChatAvatar* avatar) const { return IsInRoom(avatar->GetAvatarId()); }
 
-bool ChatRoom::IsInRoom(uint32_t avatarId) const {
-    return std::find_if(std::begin(avatars_), std::end(avatars_),
-               [avatarId](ChatAvatar* roomAvatar) { return roomAvatar->GetAvatarId() == avatarId; })
-        != std::end(avatars_);
-}
+bool ChatRoom::IsInRoom(uint32_t avatarId) const { return avatars_.Contains(avatarId); }
 
 void ChatRoom::LeaveRoom(ChatAvatar* avatar) {
-    auto avatarsIter = std::remove_if(std::begin(avatars_), std::end(avatars_),
-        [avatar](auto roomAvatar) { return roomAvatar->GetAvatarId() == avatar->GetAvatarId(); });
+    avatars_.Erase(avatar->GetAvatarId());
+    RemoveJoinedRoom(avatar);
+}
 
-    if (avatarsIter != std::end(avatars_)) {
-        avatars_.erase(avatarsIter, std::end(avatars_));
-    }
+void ChatRoom::RemoveJoinedRoom(ChatAvatar* avatar) {
+    auto& joinedRooms = avatar->rooms_;
+    joinedRooms.erase(std::remove(std::begin(joinedRooms), std::end(joinedRooms), this),
+        std::end(joinedRooms));
 }
 
 std::vector<uint32_t> ChatRoom::GetAvatarIds(const ChatAvatar * srcAvatar) const {
     std::vector<uint32_t> avatarIds;
+    avatarIds.reserve(avatars_.size());
 
     for (auto roomAvatar : avatars_) {
         if (!roomAvatar->IsIgnored(srcAvatar)) {
@@ -133,45 +139,13 @@ std::vector<std::u16string> ChatRoom::GetRemoteAddresses() const {
 
 bool ChatRoom::IsCreator(uint32_t avatarId) const { return avatarId == creatorId_; }
 
-bool ChatRoom::IsModerator(uint32_t avatarId) const {
-    if (moderators_.empty())
-        return false;
-
-    auto find_iter = std::find_if(std::begin(moderators_), std::end(moderators_),
-        [avatarId](const auto& moderator) { return moderator->GetAvatarId() == avatarId; });
-
-    return find_iter != std::end(moderators_);
-}
-
-bool ChatRoom::IsAdministrator(uint32_t avatarId) const {
-    if (administrators_.empty())
-        return false;
-
-    auto find_iter = std::find_if(std::begin(administrators_), std::end(administrators_),
-        [avatarId](const auto& administrator) { return administrator->GetAvatarId() == avatarId; });
-
-    return find_iter != std::end(administrators_);
-}
-
-bool ChatRoom::IsBanned(uint32_t avatarId) const {
-    if (banned_.empty())
-        return false;
-
-    auto find_iter = std::find_if(std::begin(banned_), std::end(banned_),
-        [avatarId](const auto& banned) { return banned->GetAvatarId() == avatarId; });
+bool ChatRoom::IsModerator(uint32_t avatarId) const { return moderators_.Contains(avatarId); }
 
-    return find_iter != std::end(banned_);
-}
+bool ChatRoom::IsAdministrator(uint32_t avatarId) const { return administrators_.Contains(avatarId); }
 
-bool ChatRoom::IsInvited(uint32_t avatarId) const {
-    if (invited_.empty())
-        return false;
+bool ChatRoom::IsBanned(uint32_t avatarId) const { return banned_.Contains(avatarId); }
 
-    auto find_iter = std::find_if(std::begin(invited_), std::end(invited_),
-        [avatarId](const auto& invited) { return invited->GetAvatarId() == avatarId; });
-
-    return find_iter != std::end(invited_);
-}
+bool ChatRoom::IsInvited(uint32_t avatarId) const { return invited_.Contains(avatarId); }
 
 void ChatRoom::KickAvatar(uint32_t srcAvatarId, ChatAvatar* destAvatar) {
     if (!IsModerator(srcAvatarId)) {
@@ -191,7 +165,7 @@ void ChatRoom::AddAdministrator(uint32_t srcAvatarId, ChatAvatar* administrator)
     }
 
     if (!IsAdministrator(administrator->GetAvatarId())) {
-        administrators_.push_back(administrator);
+        administrators_.Insert(administrator);
 
         if (IsPersistent()) {
             roomService_->PersistAdministrator(administrator->GetAvatarId(), roomId_);
@@ -208,7 +182,7 @@ void ChatRoom::AddModerator(uint32_t srcAvatarId, ChatAvatar* moderator) {
         throw ChatResultException{ChatResultCode::ROOM_DUPLICATEMODERATOR};
     }
 
-    moderators_.push_back(moderator);
+    moderators_.Insert(moderator);
 
     if (IsPersistent()) {
         roomService_->PersistModerator(moderator->GetAvatarId(), roomId_);
@@ -224,7 +198,7 @@ void ChatRoom::AddBanned(uint32_t srcAvatarId, ChatAvatar* banned) {
         throw ChatResultException{ChatResultCode::ROOM_DUPLICATEBAN};
     }
 
-    banned_.push_back(banned);
+    banned_.Insert(banned);
 
     if (IsPersistent()) {
         roomService_->PersistBanned(banned->GetAvatarId(), roomId_);
@@ -240,7 +214,7 @@ void ChatRoom::AddInvite(uint32_t srcAvatarId, ChatAvatar* invited) {
         throw ChatResultException{ChatResultCode::ROOM_DUPLICATEINVITE};
     }
 
-    invited_.push_back(invited);
+    invited_.Insert(invited);
 }
 
 void ChatRoom::RemoveAdministrator(uint32_t srcAvatarId, uint32_t avatarId) {
@@ -251,9 +225,7 @@ void ChatRoom::RemoveAdministrator(uint32_t srcAvatarId, uint32_t avatarId) {
     if (administrators_.empty())
         return;
 
-    auto administratorsEnd = std::remove_if(std::begin(administrators_), std::end(administrators_),
-        [avatarId](auto administrator) { return administrator->GetAvatarId() == avatarId; });
-    administrators_.erase(administratorsEnd, std::end(administrators_));
+    administrators_.Erase(avatarId);
 
     if (IsPersistent()) {
         roomService_->DeleteAdministrator(avatarId, roomId_);
@@ -269,9 +241,7 @@ void ChatRoom::RemoveModerator(uint32_t srcAvatarId, uint32_t avatarId) {
         throw ChatResultException{ChatResultCode::ROOM_DESTAVATARNOTMODERATOR};
     }
 
-    auto moderatorsEnd = std::remove_if(std::begin(moderators_), std::end(moderators_),
-        [avatarId](auto moderator) { return moderator->GetAvatarId() == avatarId; });
-    moderators_.erase(moderatorsEnd, std::end(moderators_));
+    moderators_.Erase(avatarId);
 
     if (IsPersistent()) {
         roomService_->DeleteModerator(avatarId, roomId_);
@@ -287,9 +257,7 @@ void ChatRoom::RemoveBanned(uint32_t srcAvatarId, uint32_t avatarId) {
         throw ChatResultException{ChatResultCode::ROOM_DESTAVATARNOTBANNED};
     }
 
-    auto bannedEnd = std::remove_if(std::begin(banned_), std::end(banned_),
-        [avatarId](auto banned) { return banned->GetAvatarId() == avatarId; });
-    banned_.erase(bannedEnd, std::end(banned_));
+    banned_.Erase(avatarId);
 
     if (IsPersistent()) {
         roomService_->DeleteBanned(avatarId, roomId_);
@@ -305,7 +273,5 @@ void ChatRoom::RemoveInvite(uint32_t srcAvatarId, uint32_t avatarId) {
         throw ChatResultException{ChatResultCode::ROOM_DESTAVATARNOTINVITED};
     }
 
-    auto invitedEnd = std::remove_if(std::begin(invited_), std::end(invited_),
-        [avatarId](auto invited) { return invited->GetAvatarId() == avatarId; });
-    invited_.erase(invitedEnd, std::end(invited_));
+    invited_.Erase(avatarId);
 }
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include "AvatarIdSet.hpp"
 #include "ChatEnums.hpp"
 
 #include <string>
@@ -24,6 +25,10 @@ public:
              const std::u16string& roomName, const std::u16string& roomTopic, const std::u16string& roomPassword,
              uint32_t roomAttributes, uint32_t maxRoomSize, const std::u16string& roomAddress,
              const std::u16string& srcAddress);
+    ~ChatRoom();
+
+    ChatRoom(const ChatRoom&) = delete;
+    ChatRoom& operator=(const ChatRoom&) = delete;
 
     bool IsPrivate() const;
     bool IsModerated() const;
@@ -51,16 +56,16 @@ public:
     uint32_t GetCreateTime() const { return createTime_; }
     uint32_t GetNodeLevel() const { return nodeLevel_; }
 
-    const std::vector<ChatAvatar*> GetAvatars() const { return avatars_; }    
+    const std::vector<ChatAvatar*>& GetAvatars() const { return avatars_.Avatars(); }
     /** Returns a list of id's in the room that are not ignoring the srcAvatar.
     */
     std::vector<uint32_t> GetAvatarIds(const ChatAvatar* srcAvatar) const;
-    const std::vector<const ChatAvatar*> GetAdminstrators() const { return administrators_; }
-    const std::vector<const ChatAvatar*> GetModerators() const { return moderators_; }
-    const std::vector<const ChatAvatar*> GetTempModerators() const { return tempModerators_; }
-    const std::vector<const ChatAvatar*> GetBanned() const { return banned_; }
-    const std::vector<const ChatAvatar*> GetInvited() const { return invited_; }
-    const std::vector<const ChatAvatar*> GetVoice() const { return voice_; }
+    const std::vector<const ChatAvatar*>& GetAdminstrators() const { return administrators_.Avatars(); }
+    const std::vector<const ChatAvatar*>& GetModerators() const { return moderators_.Avatars(); }
+    const std::vector<const ChatAvatar*>& GetTempModerators() const { return tempModerators_.Avatars(); }
+    const std::vector<const ChatAvatar*>& GetBanned() const { return banned_.Avatars(); }
+    const std::vector<const ChatAvatar*>& GetInvited() const { return invited_.Avatars(); }
+    const std::vector<const ChatAvatar*>& GetVoice() const { return voice_.Avatars(); }
 
     /* Returns the addresses of the different game servers currently with avatars
     * connected to this room.
@@ -90,6 +95,9 @@ public:
 
 private:
     friend class ChatRoomService;
+
+    void RemoveJoinedRoom(ChatAvatar* avatar);
+
     ChatRoomService* roomService_;
     std::u16string creatorName_;
     std::u16string creatorAddress_;
@@ -108,13 +116,13 @@ private:
     uint32_t roomMessageId_ = 1;
     int32_t dbId_ = -1;
 
-    std::vector<ChatAvatar*> avatars_;
-    std::vector<const ChatAvatar*> administrators_;
-    std::vector<const ChatAvatar*> moderators_;
-    std::vector<const ChatAvatar*> tempModerators_;
-    std::vector<const ChatAvatar*> banned_;
-    std::vector<const ChatAvatar*> invited_;
-    std::vector<const ChatAvatar*> voice_;
+    AvatarIdSet<ChatAvatar*> avatars_;
+    AvatarIdSet<const ChatAvatar*> administrators_;
+    AvatarIdSet<const ChatAvatar*> moderators_;
+    AvatarIdSet<const ChatAvatar*> tempModerators_;
+    AvatarIdSet<const ChatAvatar*> banned_;
+    AvatarIdSet<const ChatAvatar*> invited_;
+    AvatarIdSet<const ChatAvatar*> voice_;
 };
 
 template <typename StreamT>
@@ -1,6 +1,7 @@
 #include "ChatRoomService.hpp"
 #include "ChatAvatarService.hpp"
 #include "Database.hpp"
+#include "PersistenceQueue.hpp"
 #include "StreamUtils.hpp"
 #include "StringUtils.hpp"
 
@@ -12,17 +13,27 @@ std::string BuildInsertIgnoreSql(const IDatabaseConnection* db, const std::strin
     (void)db;
     return "INSERT IGNORE INTO " + tableName + " (" + columns + ") VALUES (" + values + ")";
 }
+
+std::string RoomScope(uint32_t roomId) {
+    return "room:" + std::to_string(roomId);
+}
+
+std::string RoomMemberKey(const std::string& list, uint32_t avatarId, uint32_t roomId) {
+    return list + ":" + std::to_string(roomId) + ":" + std::to_string(avatarId);
+}
 } // namespace
 
 
-ChatRoomService::ChatRoomService(ChatAvatarService* avatarService, IDatabaseConnection* db)
+ChatRoomService::ChatRoomService(ChatAvatarService* avatarService, IDatabaseConnection* db,
+    PersistenceQueue* persistenceQueue)
     : avatarService_{avatarService}
-    , db_{db} {}
+    , db_{db}
+    , persistenceQueue_{persistenceQueue} {}
 
 ChatRoomService::~ChatRoomService() {}
 
 void ChatRoomService::LoadRoomsFromStorage(const std::u16string& baseAddress) {
-    rooms_.clear();
+    ClearRooms();
 
     
     char sql[] = "SELECT id, creator_id, creator_name, creator_address, room_name, room_topic, "
@@ -37,33 +48,38 @@ void ChatRoomService::LoadRoomsFromStorage(const std::u16string& baseAddress) {
     LOG(INFO) << "Loading rooms for base address: " << baseAddressStr;
     stmt->BindText(baseAddressIdx, baseAddressStr);
 
+    // Nothing below queries the database while rows remain, so they are streamed rather than
+    // buffered in full.
+    stmt->EnableStreaming();
+
     while (stmt->Step() == StatementStepResult::Row) {
         auto room = std::make_unique<ChatRoom>();
-        std::string tmp;
+        boost::string_ref text;
+        room->roomService_ = this;
         room->roomId_ = nextRoomId_++;
         room->dbId_ = stmt->ColumnInt(0);
         room->creatorId_ = stmt->ColumnInt(1);
 
-        tmp = stmt->ColumnText(2);
-        room->creatorName_ = std::u16string{std::begin(tmp), std::end(tmp)};
+        text = stmt->ColumnTextView(2);
+        room->creatorName_ = std::u16string{std::begin(text), std::end(text)};
 
-        tmp = stmt->ColumnText(3);
-        room->creatorAddress_ = std::u16string{std::begin(tmp), std::end(tmp)};
+        text = stmt->ColumnTextView(3);
+        room->creatorAddress_ = std::u16string{std::begin(text), std::end(text)};
 
-        tmp = stmt->ColumnText(4);
-        room->roomName_ = std::u16string{std::begin(tmp), std::end(tmp)};
+        text = stmt->ColumnTextView(4);
+        room->roomName_ = std::u16string{std::begin(text), std::end(text)};
 
-        tmp = stmt->ColumnText(5);
-        room->roomTopic_ = std::u16string{std::begin(tmp), std::end(tmp)};
+        text = stmt->ColumnTextView(5);
+        room->roomTopic_ = std::u16string{std::begin(text), std::end(text)};
 
-        tmp = stmt->ColumnText(6);
-        room->roomPassword_ = std::u16string{std::begin(tmp), std::end(tmp)};
+        text = stmt->ColumnTextView(6);
+        room->roomPassword_ = std::u16string{std::begin(text), std::end(text)};
 
-        tmp = stmt->ColumnText(7);
-        room->roomPrefix_ = std::u16string{std::begin(tmp), std::end(tmp)};
+        text = stmt->ColumnTextView(7);
+        room->roomPrefix_ = std::u16string{std::begin(text), std::end(text)};
 
-        tmp = stmt->ColumnText(8);
-        room->roomAddress_ = std::u16string{std::begin(tmp), std::end(tmp)};
+        text = stmt->ColumnTextView(8);
+        room->roomAddress_ = std::u16string{std::begin(text), std::end(text)};
 
         room->roomAttributes_ = stmt->ColumnInt(9);
         room->maxRoomSize_ = stmt->ColumnInt(10);
@@ -72,7 +88,7 @@ void ChatRoomService::LoadRoomsFromStorage(const std::u16string& baseAddress) {
         room->nodeLevel_ = stmt->ColumnInt(13);
 
         if (!RoomExists(room->GetRoomAddress())) {
-            rooms_.emplace_back(std::move(room));
+            AddRoom(std::move(room));
         }
     }
 
@@ -92,9 +108,8 @@ ChatRoom* ChatRoomService::CreateRoom(const ChatAvatar* creator,
     LOG(INFO) << "Creating room " << FromWideString(roomName) << "@" << FromWideString(roomAddress) << " with attributes "
               << roomAttributes;
 
-    rooms_.emplace_back(std::make_unique<ChatRoom>(this, nextRoomId_++, creator, roomName,
+    roomPtr = AddRoom(std::make_unique<ChatRoom>(this, nextRoomId_++, creator, roomName,
         roomTopic, roomPassword, roomAttributes, maxRoomSize, roomAddress, srcAddress));
-    roomPtr = rooms_.back().get();
 
     if (roomPtr->IsPersistent()) {
         PersistNewRoom(*roomPtr);
@@ -108,9 +123,7 @@ void ChatRoomService::DestroyRoom(ChatRoom* room) {
         DeleteRoom(room);
     }
 
-    auto newEnd = std::remove_if(std::begin(rooms_), std::end(rooms_),
-        [room](const auto& trackedRoom) { return trackedRoom->GetRoomId() == room->GetRoomId(); });
-    rooms_.erase(newEnd, std::end(rooms_));
+    RemoveRoom(room->GetRoomId());
 }
 
 ChatResultCode ChatRoomService::PersistNewRoom(ChatRoom& room) {
@@ -184,51 +197,88 @@ std::vector<ChatRoom*> ChatRoomService::GetRoomSummaries(
     const std::u16string& startNode, const std::u16string& filter) {
     std::vector<ChatRoom*> rooms;
 
-    for (auto& room : rooms_) {
-        auto& roomAddress = room->GetRoomAddress();
-        if (roomAddress.compare(0, startNode.length(), startNode) == 0) {
-            if (!room->IsPrivate()) {
-                rooms.push_back(room.get());
-            }
-        }
-    }
+    VisitRoomSummaries(startNode, filter, [&rooms](ChatRoom* room) {
+        rooms.push_back(room);
+        return true;
+    });
 
     return rooms;
 }
 
+void ChatRoomService::VisitRoomSummaries(const std::u16string& startNode,
+    const std::u16string& filter, const std::function<bool(ChatRoom*)>& visitor) {
+    for (auto iter = summaryIndex_.lower_bound(startNode); iter != std::end(summaryIndex_); ++iter) {
+        if (iter->first.compare(0, startNode.length(), startNode) != 0) {
+            break;
+        }
+
+        if (!filter.empty() && iter->second->GetRoomName().find(filter) == std::u16string::npos) {
+            continue;
+        }
+
+        if (!visitor(iter->second)) {
+            break;
+        }
+    }
+}
+
 bool ChatRoomService::RoomExists(const std::u16string& roomAddress) const {
-    return std::find_if(std::begin(rooms_), std::end(rooms_), [roomAddress](auto& room) {
-        return roomAddress.compare(room->GetRoomAddress()) == 0;
-    }) != std::end(rooms_);
+    return roomsByAddress_.find(roomAddress) != std::end(roomsByAddress_);
 }
 
 ChatRoom* ChatRoomService::GetRoom(const std::u16string& roomAddress) {
-    ChatRoom* room = nullptr;
+    auto find_iter = roomsByAddress_.find(roomAddress);
+    return find_iter != std::end(roomsByAddress_) ? find_iter->second : nullptr;
+}
 
-    auto find_iter = std::find_if(std::begin(rooms_), std::end(rooms_),
-        [roomAddress](auto& room) { return roomAddress.compare(room->GetRoomAddress()) == 0; });
+ChatRoom* ChatRoomService::GetRoom(uint32_t roomId) {
+    auto find_iter = rooms_.find(roomId);
+    return find_iter != std::end(rooms_) ? find_iter->second.get() : nullptr;
+}
+
+std::vector<ChatRoom*> ChatRoomService::GetJoinedRooms(const ChatAvatar * avatar) {
+    return avatar->GetJoinedRooms();
+}
 
-    if (find_iter != std::end(rooms_)) {
-        room = find_iter->get();
+ChatRoom* ChatRoomService::AddRoom(std::unique_ptr<ChatRoom> room) {
+    auto roomPtr = room.get();
+
+    roomsByAddress_[roomPtr->GetRoomAddress()] = roomPtr;
+    if (!roomPtr->IsPrivate()) {
+        summaryIndex_[roomPtr->GetRoomAddress()] = roomPtr;
     }
+    rooms_[roomPtr->GetRoomId()] = std::move(room);
 
-    return room;
+    return roomPtr;
 }
 
-std::vector<ChatRoom*> ChatRoomService::GetJoinedRooms(const ChatAvatar * avatar) {
-    std::vector<ChatRoom*> rooms;
-
-    for (auto& room : rooms_) {
-        if (room->IsInRoom(avatar->GetAvatarId())) {
-            rooms.push_back(room.get());
-        }
+void ChatRoomService::RemoveRoom(uint32_t roomId) {
+    auto find_iter = rooms_.find(roomId);
+    if (find_iter == std::end(rooms_)) {
+        return;
     }
 
-    return rooms;
+    auto& roomAddress = find_iter->second->GetRoomAddress();
+    roomsByAddress_.erase(roomAddress);
+    summaryIndex_.erase(roomAddress);
+    rooms_.erase(find_iter);
+}
+
+void ChatRoomService::ClearRooms() {
+    roomsByAddress_.clear();
+    summaryIndex_.clear();
+    rooms_.clear();
 }
 
 void ChatRoomService::DeleteRoom(ChatRoom* room) {
-        char sql[] = "DELETE FROM room WHERE id = @id";
+    // Queued member list writes for the room must not land after the room row is gone.
+    if (persistenceQueue_
+        && !persistenceQueue_->WaitForScope(RoomScope(room->GetRoomId()), kPersistenceWaitTimeout)) {
+        throw DatabaseException{"timed out waiting for queued writes before deleting room "
+            + std::to_string(room->GetRoomId())};
+    }
+
+    char sql[] = "DELETE FROM room WHERE id = @id";
 
     StatementHandle stmt{db_->Prepare(sql)};
 
@@ -248,36 +298,31 @@ void ChatRoomService::LoadModerators(ChatRoom * room) {
 
     while (stmt->Step() == StatementStepResult::Row) {
         uint32_t moderatorId = stmt->ColumnInt(0);
-        room->moderators_.push_back(avatarService_->GetAvatar(moderatorId));
+        auto moderator = avatarService_->GetAvatar(moderatorId);
+        if (moderator) {
+            room->moderators_.Insert(moderator);
+        }
     }
 }
 
 void ChatRoomService::PersistModerator(uint32_t moderatorId, uint32_t roomId) {
-        auto sql = BuildInsertIgnoreSql(db_, "room_moderator", "moderator_avatar_id, room_id", "@moderator_avatar_id, @room_id");
-
-    StatementHandle stmt{db_->Prepare(sql)};
-
-    int moderatorAvatarIdIdx = stmt->BindParameterIndex("@moderator_avatar_id");
-    int roomIdIdx = stmt->BindParameterIndex("@room_id");
+    PersistenceOp op{PersistenceOpKind::Insert,
+        BuildInsertIgnoreSql(db_, "room_moderator", "moderator_avatar_id, room_id", "@moderator_avatar_id, @room_id"),
+        {}, RoomMemberKey("moderator", moderatorId, roomId), RoomScope(roomId)};
 
-    stmt->BindInt(moderatorAvatarIdIdx, moderatorId);
-    stmt->BindInt(roomIdIdx, roomId);
+    op.BindInt("@moderator_avatar_id", moderatorId).BindInt("@room_id", roomId);
 
-    stmt.ExpectDone();
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 }
 
 void ChatRoomService::DeleteModerator(uint32_t moderatorId, uint32_t roomId) {
-        char sql[] = "DELETE FROM room_moderator WHERE moderator_avatar_id = @moderator_avatar_id AND room_id = @room_id";
-
-    StatementHandle stmt{db_->Prepare(sql)};
+    PersistenceOp op{PersistenceOpKind::Delete,
+        "DELETE FROM room_moderator WHERE moderator_avatar_id = @moderator_avatar_id AND room_id = @room_id",
+        {}, RoomMemberKey("moderator", moderatorId, roomId), RoomScope(roomId)};
 
-    int moderatorAvatarIdIdx = stmt->BindParameterIndex("@moderator_avatar_id");
-    int roomIdIdx = stmt->BindParameterIndex("@room_id");
+    op.BindInt("@moderator_avatar_id", moderatorId).BindInt("@room_id", roomId);
 
-    stmt->BindInt(moderatorAvatarIdIdx, moderatorId);
-    stmt->BindInt(roomIdIdx, roomId);
-
-    stmt.ExpectDone();
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 }
 
 void ChatRoomService::LoadAdministrators(ChatRoom * room) {
@@ -290,36 +335,31 @@ void ChatRoomService::LoadAdministrators(ChatRoom * room) {
 
     while (stmt->Step() == StatementStepResult::Row) {
         uint32_t administratorId = stmt->ColumnInt(0);
-        room->administrators_.push_back(avatarService_->GetAvatar(administratorId));
+        auto administrator = avatarService_->GetAvatar(administratorId);
+        if (administrator) {
+            room->administrators_.Insert(administrator);
+        }
     }
 }
 
 void ChatRoomService::PersistAdministrator(uint32_t administratorId, uint32_t roomId) {
-        auto sql = BuildInsertIgnoreSql(db_, "room_administrator", "administrator_avatar_id, room_id", "@administrator_avatar_id, @room_id");
-
-    StatementHandle stmt{db_->Prepare(sql)};
-
-    int administratorAvatarIdIdx = stmt->BindParameterIndex("@administrator_avatar_id");
-    int roomIdIdx = stmt->BindParameterIndex("@room_id");
+    PersistenceOp op{PersistenceOpKind::Insert,
+        BuildInsertIgnoreSql(db_, "room_administrator", "administrator_avatar_id, room_id", "@administrator_avatar_id, @room_id"),
+        {}, RoomMemberKey("administrator", administratorId, roomId), RoomScope(roomId)};
 
-    stmt->BindInt(administratorAvatarIdIdx, administratorId);
-    stmt->BindInt(roomIdIdx, roomId);
+    op.BindInt("@administrator_avatar_id", administratorId).BindInt("@room_id", roomId);
 
-    stmt.ExpectDone();
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 }
 
 void ChatRoomService::DeleteAdministrator(uint32_t administratorId, uint32_t roomId) {
-        char sql[] = "DELETE FROM room_administrator WHERE administrator_avatar_id = @administrator_avatar_id AND room_id = @room_id";
+    PersistenceOp op{PersistenceOpKind::Delete,
+        "DELETE FROM room_administrator WHERE administrator_avatar_id = @administrator_avatar_id AND room_id = @room_id",
+        {}, RoomMemberKey("administrator", administratorId, roomId), RoomScope(roomId)};
 
-    StatementHandle stmt{db_->Prepare(sql)};
-
-    int administratorAvatarIdIdx = stmt->BindParameterIndex("@administrator_avatar_id");
-    int roomIdIdx = stmt->BindParameterIndex("@room_id");
-
-    stmt->BindInt(administratorAvatarIdIdx, administratorId);
-    stmt->BindInt(roomIdIdx, roomId);
+    op.BindInt("@administrator_avatar_id", administratorId).BindInt("@room_id", roomId);
 
-    stmt.ExpectDone();
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 }
 
 void ChatRoomService::LoadBanned(ChatRoom * room) {
@@ -332,34 +372,29 @@ void ChatRoomService::LoadBanned(ChatRoom * room) {
 
     while (stmt->Step() == StatementStepResult::Row) {
         uint32_t bannedId = stmt->ColumnInt(0);
-        room->banned_.push_back(avatarService_->GetAvatar(bannedId));
+        auto banned = avatarService_->GetAvatar(bannedId);
+        if (banned) {
+            room->banned_.Insert(banned);
+        }
     }
 }
 
 void ChatRoomService::PersistBanned(uint32_t bannedId, uint32_t roomId) {
-        auto sql = BuildInsertIgnoreSql(db_, "room_ban", "banned_avatar_id, room_id", "@banned_avatar_id, @room_id");
-
-    StatementHandle stmt{db_->Prepare(sql)};
+    PersistenceOp op{PersistenceOpKind::Insert,
+        BuildInsertIgnoreSql(db_, "room_ban", "banned_avatar_id, room_id", "@banned_avatar_id, @room_id"),
+        {}, RoomMemberKey("banned", bannedId, roomId), RoomScope(roomId)};
 
-    int bannedAvatarIdIdx = stmt->BindParameterIndex("@banned_avatar_id");
-    int roomIdIdx = stmt->BindParameterIndex("@room_id");
-
-    stmt->BindInt(bannedAvatarIdIdx, bannedId);
-    stmt->BindInt(roomIdIdx, roomId);
+    op.BindInt("@banned_avatar_id", bannedId).BindInt("@room_id", roomId);
 
-    stmt.ExpectDone();
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 }
 
 void ChatRoomService::DeleteBanned(uint32_t bannedId, uint32_t roomId) {
-        char sql[] = "DELETE FROM room_ban WHERE banned_avatar_id = @banned_avatar_id AND room_id = @room_id";
-
-    StatementHandle stmt{db_->Prepare(sql)};
-
-    int bannedAvatarIdIdx = stmt->BindParameterIndex("@banned_avatar_id");
-    int roomIdIdx = stmt->BindParameterIndex("@room_id");
+    PersistenceOp op{PersistenceOpKind::Delete,
+        "DELETE FROM room_ban WHERE banned_avatar_id = @banned_avatar_id AND room_id = @room_id",
+        {}, RoomMemberKey("banned", bannedId, roomId), RoomScope(roomId)};
 
-    stmt->BindInt(bannedAvatarIdIdx, bannedId);
-    stmt->BindInt(roomIdIdx, roomId);
+    op.BindInt("@banned_avatar_id", bannedId).BindInt("@room_id", roomId);
 
-    stmt.ExpectDone();
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 }
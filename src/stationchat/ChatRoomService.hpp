@@ -7,17 +7,25 @@
 #include <boost/optional.hpp>
 
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 class IDatabaseConnection;
+class PersistenceQueue;
 
 class ChatAvatarService;
 
 class ChatRoomService {
 public:
-    ChatRoomService(ChatAvatarService* avatarService, IDatabaseConnection* db);
+    /** Moderator, administrator and ban list writes go through persistenceQueue when one is
+    * given and are executed synchronously otherwise.
+    */
+    ChatRoomService(ChatAvatarService* avatarService, IDatabaseConnection* db,
+        PersistenceQueue* persistenceQueue = nullptr);
     ~ChatRoomService();
 
     void LoadRoomsFromStorage(const std::u16string& baseAddress);
@@ -31,16 +39,31 @@ public:
 
     ChatResultCode PersistNewRoom(ChatRoom& avatar);
 
+    /** Returns the public rooms whose address starts with startNode and whose name contains
+    * filter (an empty filter matches every room), ordered by address.
+    */
     std::vector<ChatRoom*> GetRoomSummaries(
         const std::u16string& startNode, const std::u16string& filter = u"");
 
+    /** Streaming form of GetRoomSummaries; visitor is invoked once per matching room and may
+    * return false to stop the walk early.
+    */
+    void VisitRoomSummaries(const std::u16string& startNode, const std::u16string& filter,
+        const std::function<bool(ChatRoom*)>& visitor);
+
     bool RoomExists(const std::u16string& roomAddress) const;
     ChatRoom* GetRoom(const std::u16string& roomAddress);
+    ChatRoom* GetRoom(uint32_t roomId);
 
+    /** Returns a copy of the avatar's joined rooms so callers can leave rooms while iterating. */
     std::vector<ChatRoom*> GetJoinedRooms(const ChatAvatar* avatar);
 
 private:
     friend class ChatRoom;
+    ChatRoom* AddRoom(std::unique_ptr<ChatRoom> room);
+    void RemoveRoom(uint32_t roomId);
+    void ClearRooms();
+
     void DeleteRoom(ChatRoom* room);
     void LoadModerators(ChatRoom* room);
     void PersistModerator(uint32_t moderatorId, uint32_t roomId);
@@ -53,7 +76,13 @@ private:
     void DeleteBanned(uint32_t bannedId, uint32_t roomId);
 
     uint32_t nextRoomId_ = 0;
-    std::vector<std::unique_ptr<ChatRoom>> rooms_;
+    // rooms_ owns every room; roomsByAddress_ and summaryIndex_ index the same objects and must
+    // be updated alongside it. summaryIndex_ is sorted by address and holds only public rooms so
+    // a prefix walk touches nothing but candidate summaries.
+    std::unordered_map<uint32_t, std::unique_ptr<ChatRoom>> rooms_;
+    std::unordered_map<std::u16string, ChatRoom*> roomsByAddress_;
+    std::map<std::u16string, ChatRoom*> summaryIndex_;
     ChatAvatarService* avatarService_;
     IDatabaseConnection* db_;
+    PersistenceQueue* persistenceQueue_;
 };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <boost/utility/string_ref.hpp>
+
 #include <cstdint>
 #include <memory>
 #include <stdexcept>
@@ -32,6 +34,29 @@ private:
     int code_;
 };
 
+/** True for errors that say nothing about the statement itself (a lost or refused connection,
+* a deadlock or lock wait timeout), so running it again later may succeed. Codes are those of
+* the MariaDB client and server; an error without a code is a usage error and never transient.
+*/
+inline bool IsTransientDatabaseError(const DatabaseException& e) {
+    switch (e.Code()) {
+    case 2002: // CR_CONNECTION_ERROR
+    case 2003: // CR_CONN_HOST_ERROR
+    case 2005: // CR_UNKNOWN_HOST
+    case 2006: // CR_SERVER_GONE_ERROR
+    case 2013: // CR_SERVER_LOST
+    case 2055: // CR_SERVER_LOST_EXTENDED
+    case 1040: // ER_CON_COUNT_ERROR
+    case 1053: // ER_SERVER_SHUTDOWN
+    case 1205: // ER_LOCK_WAIT_TIMEOUT
+    case 1213: // ER_LOCK_DEADLOCK
+    case 1927: // ER_CONNECTION_KILLED
+        return true;
+    default:
+        return false;
+    }
+}
+
 class IStatement {
 public:
     virtual ~IStatement() = default;
@@ -41,10 +66,19 @@ public:
     virtual void BindText(int index, const std::string& value) = 0;
     virtual void BindBlob(int index, const uint8_t* data, size_t length) = 0;
 
+    /** Asks for rows to be pulled from the server as they are stepped through rather than
+    * buffered in full on the first Step. Must be called before the first Step; backends that
+    * cannot stream ignore it. While a streaming statement has unread rows its connection cannot
+    * run another statement, so the loop body must not touch the database.
+    */
+    virtual void EnableStreaming() {}
+
     virtual StatementStepResult Step() = 0;
 
     virtual int ColumnInt(int index) const = 0;
     virtual std::string ColumnText(int index) const = 0;
+    /** Like ColumnText without the copy; the view is valid until the next Step. */
+    virtual boost::string_ref ColumnTextView(int index) const = 0;
     virtual const uint8_t* ColumnBlob(int index) const = 0;
     virtual int ColumnBytes(int index) const = 0;
 };
@@ -85,6 +119,11 @@ public:
     virtual uint64_t GetLastInsertId() const = 0;
     virtual std::string BackendName() const = 0;
     virtual const DatabaseCapabilities& Capabilities() const = 0;
+
+    /** Checks that the server is still reachable, reconnecting if the backend supports it.
+    * Returns false if the connection is unusable and should be replaced.
+    */
+    virtual bool Ping() { return true; }
 };
 
 inline std::string IgnoreTableIdentifierForBackend(const std::string& backendName) {
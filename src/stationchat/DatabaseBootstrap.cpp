@@ -10,7 +10,8 @@ constexpr int kRequiredSchemaVersion = 1;
 
 std::vector<std::pair<int, std::string>> MigrationCatalogForBackend(const std::string& backend) {
     if (backend == "mariadb") {
-        return {{1, "extras/migrations/mariadb/V001__baseline.sql"}};
+        return {{1, "extras/migrations/mariadb/V001__baseline.sql"},
+            {2, "extras/migrations/mariadb/V002__persistent_message_header_index.sql"}};
     }
 
     throw DatabaseException(backend, 0, "unknown database backend for migration lookup");
@@ -25,7 +26,7 @@ bool TableExists(IDatabaseConnection& db, const std::string& tableName) {
 }
 
 int ReadSchemaVersion(IDatabaseConnection& db) {
-    StatementHandle stmt{db.Prepare("SELECT version FROM schema_version LIMIT 1")};
+    StatementHandle stmt{db.Prepare("SELECT version FROM schema_version ORDER BY version DESC LIMIT 1")};
     if (stmt->Step() != StatementStepResult::Row) {
         throw DatabaseException(db.BackendName(), 0,
             "schema_version exists but has no rows. Apply baseline migration V001 before starting stationchat");
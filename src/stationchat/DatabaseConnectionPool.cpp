@@ -0,0 +1,126 @@
+#include "DatabaseConnectionPool.hpp"
+#include "Database.hpp"
+
+#include <easylogging++.h>
+
+#include <algorithm>
+
+DatabaseConnectionLease::DatabaseConnectionLease(
+    DatabaseConnectionPool* pool, std::unique_ptr<IDatabaseConnection> connection)
+    : pool_{pool}
+    , connection_{std::move(connection)} {}
+
+DatabaseConnectionLease::~DatabaseConnectionLease() {
+    if (connection_) {
+        pool_->Return(std::move(connection_));
+    }
+}
+
+DatabaseConnectionPool::DatabaseConnectionPool(
+    ConnectionFactory factory, size_t size, std::chrono::milliseconds healthCheckInterval)
+    : factory_{std::move(factory)}
+    , healthCheckInterval_{healthCheckInterval} {
+    CHECK(size > 0) << "database connection pool requires at least one connection";
+
+    stats_.size = size;
+
+    // Opened up front so that bad settings fail at startup rather than on the first lease.
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < size; ++i) {
+        idle_.push_back(IdleConnection{factory_(), now});
+        ++open_;
+    }
+}
+
+DatabaseConnectionPool::~DatabaseConnectionPool() = default;
+
+DatabaseConnectionLease DatabaseConnectionPool::Lease() {
+    auto start = std::chrono::steady_clock::now();
+    bool waited = false;
+
+    std::unique_lock<std::mutex> lock{mutex_};
+
+    while (idle_.empty()) {
+        if (open_ < stats_.size) {
+            // A connection was lost earlier and could not be replaced then; try again.
+            ++open_;
+            lock.unlock();
+
+            try {
+                auto connection = factory_();
+                lock.lock();
+                ++stats_.leases;
+                ++stats_.replaced;
+                return DatabaseConnectionLease{this, std::move(connection)};
+            } catch (...) {
+                lock.lock();
+                --open_;
+                throw;
+            }
+        }
+
+        waited = true;
+        returned_.wait(lock);
+    }
+
+    auto idle = std::move(idle_.back());
+    idle_.pop_back();
+
+    ++stats_.leases;
+    if (waited) {
+        auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+
+        ++stats_.waits;
+        stats_.totalWait += wait;
+        stats_.maxWait = std::max(stats_.maxWait, wait);
+    }
+
+    lock.unlock();
+
+    return DatabaseConnectionLease{this, CheckHealth(std::move(idle))};
+}
+
+DatabaseConnectionPoolStats DatabaseConnectionPool::GetStats() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    auto stats = stats_;
+    stats.idle = idle_.size();
+    return stats;
+}
+
+void DatabaseConnectionPool::Return(std::unique_ptr<IDatabaseConnection> connection) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        idle_.push_back(IdleConnection{std::move(connection), std::chrono::steady_clock::now()});
+    }
+
+    returned_.notify_one();
+}
+
+std::unique_ptr<IDatabaseConnection> DatabaseConnectionPool::CheckHealth(IdleConnection idle) {
+    if (std::chrono::steady_clock::now() - idle.returnedAt < healthCheckInterval_
+        || idle.connection->Ping()) {
+        return std::move(idle.connection);
+    }
+
+    LOG(WARNING) << "Pooled database connection failed its health check; reconnecting";
+    idle.connection.reset();
+
+    try {
+        auto connection = factory_();
+
+        std::lock_guard<std::mutex> lock{mutex_};
+        ++stats_.replaced;
+        return connection;
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            --open_;
+        }
+
+        // Lets a waiting lease retry opening the connection that was just lost.
+        returned_.notify_one();
+        throw;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class IDatabaseConnection;
+class DatabaseConnectionPool;
+
+struct DatabaseConnectionPoolStats {
+    size_t size = 0;
+    size_t idle = 0;
+    uint64_t leases = 0;
+    // Leases that found no idle connection and had to wait for one to be returned.
+    uint64_t waits = 0;
+    uint64_t replaced = 0;
+    std::chrono::microseconds totalWait{0};
+    std::chrono::microseconds maxWait{0};
+};
+
+/** Exclusive use of a pooled connection; the connection is returned when the lease ends. */
+class DatabaseConnectionLease {
+public:
+    DatabaseConnectionLease(DatabaseConnectionPool* pool, std::unique_ptr<IDatabaseConnection> connection);
+    DatabaseConnectionLease(DatabaseConnectionLease&& other) = default;
+    ~DatabaseConnectionLease();
+
+    DatabaseConnectionLease(const DatabaseConnectionLease&) = delete;
+    DatabaseConnectionLease& operator=(const DatabaseConnectionLease&) = delete;
+
+    IDatabaseConnection* operator->() { return connection_.get(); }
+    IDatabaseConnection& operator*() { return *connection_; }
+
+private:
+    DatabaseConnectionPool* pool_;
+    std::unique_ptr<IDatabaseConnection> connection_;
+};
+
+/** Fixed-size set of connections leased to one thread at a time.
+*
+* Every connection is opened, and so has its session configured, by the factory. A connection
+* that sat idle for longer than the health check interval is pinged before it is leased and
+* replaced through the factory if it no longer answers. Lease blocks while every connection is
+* in use; the time spent waiting is reported in the stats.
+*/
+class DatabaseConnectionPool {
+public:
+    using ConnectionFactory = std::function<std::unique_ptr<IDatabaseConnection>()>;
+
+    DatabaseConnectionPool(ConnectionFactory factory, size_t size,
+        std::chrono::milliseconds healthCheckInterval = std::chrono::seconds{30});
+    ~DatabaseConnectionPool();
+
+    DatabaseConnectionPool(const DatabaseConnectionPool&) = delete;
+    DatabaseConnectionPool& operator=(const DatabaseConnectionPool&) = delete;
+
+    DatabaseConnectionLease Lease();
+
+    DatabaseConnectionPoolStats GetStats() const;
+
+private:
+    friend class DatabaseConnectionLease;
+
+    struct IdleConnection {
+        std::unique_ptr<IDatabaseConnection> connection;
+        std::chrono::steady_clock::time_point returnedAt;
+    };
+
+    void Return(std::unique_ptr<IDatabaseConnection> connection);
+    std::unique_ptr<IDatabaseConnection> CheckHealth(IdleConnection idle);
+
+    ConnectionFactory factory_;
+    std::chrono::milliseconds healthCheckInterval_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable returned_;
+    std::vector<IdleConnection> idle_;
+    // Connections that exist, leased or idle; below size_ only after a replacement failed.
+    size_t open_ = 0;
+    DatabaseConnectionPoolStats stats_;
+};
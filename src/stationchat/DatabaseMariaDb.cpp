@@ -6,16 +6,23 @@
 #include <mysql/errmsg.h>
 
 #include <algorithm>
-#include <array>
 #include <cctype>
 #include <memory>
-#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace {
 
+// Initial column buffer for streamed results, whose value lengths are not known up front.
+// Longer values are fetched again into a buffer grown to fit.
+constexpr unsigned long kStreamingColumnBufferSize = 1024;
+
+// Blob parameters above this size are sent ahead of the execute in chunks rather than inline,
+// so a large payload never has to fit in a single execute packet.
+constexpr size_t kLongDataThreshold = 16 * 1024;
+constexpr size_t kLongDataChunkSize = 64 * 1024;
 
 DatabaseException MakeMariaDbError(MYSQL* handle, unsigned int code, const std::string& context) {
     const char* rawMessage = handle ? mysql_error(handle) : nullptr;
@@ -23,31 +30,13 @@ DatabaseException MakeMariaDbError(MYSQL* handle, unsigned int code, const std::
     return DatabaseException("mariadb", static_cast<int>(code), context + ": " + message);
 }
 
-std::string EscapeString(MYSQL* handle, const std::string& input) {
-    std::string out;
-    out.resize(input.size() * 2 + 1);
-    auto written = mysql_real_escape_string(handle, &out[0], input.c_str(), input.size());
-    out.resize(written);
-    return out;
+DatabaseException MakeMariaDbStatementError(MYSQL_STMT* stmt, const std::string& context) {
+    const char* rawMessage = stmt ? mysql_stmt_error(stmt) : nullptr;
+    std::string message = rawMessage && *rawMessage ? rawMessage : "unknown mariadb error";
+    return DatabaseException("mariadb", stmt ? static_cast<int>(mysql_stmt_errno(stmt)) : 0,
+        context + ": " + message);
 }
 
-std::string BlobToHex(const uint8_t* data, size_t length) {
-    static const std::array<char, 16> kHex = {'0', '1', '2', '3', '4', '5', '6', '7',
-        '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-
-    std::string out;
-    out.reserve(length * 2 + 3);
-    out += "X'";
-    for (size_t i = 0; i < length; ++i) {
-        uint8_t value = data[i];
-        out.push_back(kHex[(value >> 4) & 0x0F]);
-        out.push_back(kHex[value & 0x0F]);
-    }
-    out.push_back('\'');
-    return out;
-}
-
-
 std::string ToLowerCopy(const std::string& value) {
     std::string out = value;
     std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c) {
@@ -129,19 +118,129 @@ void ConfigureSession(MYSQL* handle) {
     }
 }
 
+bool IsIntegerField(enum_field_types type) {
+    return type == MYSQL_TYPE_TINY || type == MYSQL_TYPE_SHORT || type == MYSQL_TYPE_LONG
+        || type == MYSQL_TYPE_INT24 || type == MYSQL_TYPE_LONGLONG;
+}
+
+bool IsBlobField(enum_field_types type) {
+    return type == MYSQL_TYPE_BLOB || type == MYSQL_TYPE_LONG_BLOB;
+}
+
+/** Connection handle shared by a connection and the statements it prepared.
+*
+* Server-side statement handles are cached per SQL string. A handle is taken out of the
+* cache while a statement uses it and returned when the statement is destroyed, so nested
+* statements with the same SQL each get their own handle. A reconnect invalidates every
+* server-side handle; the generation counter keeps handles prepared before it from being
+* returned to the cache.
+*/
+class MariaDbSession {
+public:
+    struct CachedSql {
+        NormalizedSql normalized;
+        std::vector<MYSQL_STMT*> idle;
+    };
+
+    explicit MariaDbSession(MYSQL* handle)
+        : handle_{handle} {}
+
+    ~MariaDbSession() {
+        CloseIdle();
+        mysql_close(handle_);
+    }
+
+    MariaDbSession(const MariaDbSession&) = delete;
+    MariaDbSession& operator=(const MariaDbSession&) = delete;
+
+    MYSQL* Handle() const { return handle_; }
+    uint64_t Generation() const { return generation_; }
+
+    /** Entries are never erased, so the returned reference lives as long as the session. */
+    CachedSql& Lookup(const std::string& sql) {
+        auto find_iter = statements_.find(sql);
+        if (find_iter == std::end(statements_)) {
+            find_iter = statements_.emplace(sql, CachedSql{NormalizeNamedParameters(sql), {}}).first;
+        }
+
+        return find_iter->second;
+    }
+
+    MYSQL_STMT* Acquire(CachedSql& entry) {
+        if (!entry.idle.empty()) {
+            auto stmt = entry.idle.back();
+            entry.idle.pop_back();
+            return stmt;
+        }
+
+        auto stmt = mysql_stmt_init(handle_);
+        if (!stmt) {
+            throw MakeMariaDbError(handle_, mysql_errno(handle_), "statement init failed");
+        }
+
+        my_bool updateMaxLength = 1;
+        mysql_stmt_attr_set(stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &updateMaxLength);
+
+        const auto& sql = entry.normalized.sql;
+        if (mysql_stmt_prepare(stmt, sql.c_str(), static_cast<unsigned long>(sql.size())) != 0) {
+            auto error = MakeMariaDbStatementError(stmt, "prepare failed");
+            mysql_stmt_close(stmt);
+            throw error;
+        }
+
+        return stmt;
+    }
+
+    void Release(CachedSql& entry, MYSQL_STMT* stmt, uint64_t generation) {
+        if (generation == generation_) {
+            entry.idle.push_back(stmt);
+        } else {
+            mysql_stmt_close(stmt);
+        }
+    }
+
+    /** Called after the connection was re-established; prepared handles did not survive it. */
+    void Reconnected() {
+        CloseIdle();
+        ++generation_;
+        ConfigureSession(handle_);
+    }
+
+    uint64_t GetLastInsertId() const { return lastInsertId_; }
+    void SetLastInsertId(uint64_t lastInsertId) { lastInsertId_ = lastInsertId; }
+
+private:
+    void CloseIdle() {
+        for (auto& statement : statements_) {
+            for (auto stmt : statement.second.idle) {
+                mysql_stmt_close(stmt);
+            }
+
+            statement.second.idle.clear();
+        }
+    }
+
+    MYSQL* handle_;
+    uint64_t generation_ = 0;
+    uint64_t lastInsertId_ = 0;
+    std::unordered_map<std::string, CachedSql> statements_;
+};
+
 class MariaDbStatement final : public IStatement {
 public:
-    MariaDbStatement(MYSQL* handle, const std::string& sql)
-        : handle_{handle}
+    MariaDbStatement(std::shared_ptr<MariaDbSession> session, const std::string& sql)
+        : session_{std::move(session)}
+        , entry_{session_->Lookup(sql)}
+        , stmt_{session_->Acquire(entry_)}
+        , generation_{session_->Generation()}
         , executed_{false}
-        , rowIndex_{0} {
-        normalizedSql_ = NormalizeNamedParameters(sql);
-        boundValues_.resize(normalizedSql_.positionsByLogicalIndex.size());
+        , streaming_{false} {
+        boundValues_.resize(entry_.normalized.positionsByLogicalIndex.size());
     }
 
     int BindParameterIndex(const std::string& name) const override {
-        auto iter = normalizedSql_.logicalIndexByName.find(name);
-        if (iter == normalizedSql_.logicalIndexByName.end()) {
+        auto iter = entry_.normalized.logicalIndexByName.find(name);
+        if (iter == entry_.normalized.logicalIndexByName.end()) {
             throw DatabaseException("mariadb", 0, "missing parameter: " + name);
         }
         return iter->second;
@@ -158,14 +257,22 @@ public:
         EnsureIndex(index);
         auto& slot = boundValues_[index];
         slot.type = BoundValue::Type::Text;
-        slot.textValue = value;
+        slot.bytes.assign(std::begin(value), std::end(value));
     }
 
     void BindBlob(int index, const uint8_t* data, size_t length) override {
         EnsureIndex(index);
         auto& slot = boundValues_[index];
         slot.type = BoundValue::Type::Blob;
-        slot.blobValue.assign(data, data + length);
+        slot.bytes.assign(data, data + length);
+    }
+
+    void EnableStreaming() override {
+        if (executed_) {
+            throw DatabaseException("mariadb", 0, "streaming must be enabled before the first step");
+        }
+
+        streaming_ = true;
     }
 
     StatementStepResult Step() override {
@@ -173,52 +280,91 @@ public:
             Execute();
         }
 
-        if (result_) {
-            if (rowIndex_ < rowCount_) {
-                currentRow_ = mysql_fetch_row(result_);
-                currentLengths_ = mysql_fetch_lengths(result_);
-                ++rowIndex_;
-                return StatementStepResult::Row;
-            }
+        if (columns_.empty()) {
             return StatementStepResult::Done;
         }
 
-        return StatementStepResult::Done;
+        auto result = mysql_stmt_fetch(stmt_);
+        if (result == 0) {
+            return StatementStepResult::Row;
+        }
+
+        if (result == MYSQL_DATA_TRUNCATED) {
+            FetchTruncatedColumns();
+            return StatementStepResult::Row;
+        }
+
+        if (result == MYSQL_NO_DATA) {
+            return StatementStepResult::Done;
+        }
+
+        throw MakeMariaDbStatementError(stmt_, "fetch failed");
     }
 
     int ColumnInt(int index) const override {
-        return std::stoi(ColumnText(index));
+        const auto& column = GetColumn(index);
+        if (column.isNull) {
+            return 0;
+        }
+
+        if (column.isInteger) {
+            return static_cast<int>(column.intValue);
+        }
+
+        return std::stoi(std::string(column.buffer.data(), column.length));
     }
 
     std::string ColumnText(int index) const override {
-        if (!currentRow_) {
+        const auto& column = GetColumn(index);
+        if (column.isNull) {
             return "";
         }
-        const char* value = currentRow_[index];
-        if (!value) {
-            return "";
+
+        if (column.isInteger) {
+            return std::to_string(column.intValue);
+        }
+
+        return std::string(column.buffer.data(), column.length);
+    }
+
+    boost::string_ref ColumnTextView(int index) const override {
+        const auto& column = GetColumn(index);
+        if (column.isNull) {
+            return {};
         }
-        return std::string(value, currentLengths_[index]);
+
+        if (column.isInteger) {
+            column.text = std::to_string(column.intValue);
+            return column.text;
+        }
+
+        return boost::string_ref(column.buffer.data(), column.length);
     }
 
     const uint8_t* ColumnBlob(int index) const override {
-        if (!currentRow_) {
+        const auto& column = GetColumn(index);
+        if (column.isNull || column.isInteger) {
             return nullptr;
         }
-        return reinterpret_cast<const uint8_t*>(currentRow_[index]);
+        return reinterpret_cast<const uint8_t*>(column.buffer.data());
     }
 
     int ColumnBytes(int index) const override {
-        if (!currentLengths_) {
+        const auto& column = GetColumn(index);
+        if (column.isNull || column.isInteger) {
             return 0;
         }
-        return static_cast<int>(currentLengths_[index]);
+        return static_cast<int>(column.length);
     }
 
     ~MariaDbStatement() override {
-        if (result_) {
-            mysql_free_result(result_);
+        // Also discards any rows of a streamed result that were not stepped through, which
+        // leaves the connection free for the next statement.
+        if (!columns_.empty()) {
+            mysql_stmt_free_result(stmt_);
         }
+
+        session_->Release(entry_, stmt_, generation_);
     }
 
 private:
@@ -232,8 +378,19 @@ private:
 
         Type type = Type::None;
         int64_t intValue = 0;
-        std::string textValue;
-        std::vector<uint8_t> blobValue;
+        std::vector<char> bytes;
+        unsigned long length = 0;
+    };
+
+    struct Column {
+        bool isInteger = false;
+        int64_t intValue = 0;
+        std::vector<char> buffer;
+        unsigned long length = 0;
+        my_bool isNull = 0;
+        my_bool error = 0;
+        // Backs ColumnTextView for integer columns.
+        mutable std::string text;
     };
 
     void EnsureIndex(int index) {
@@ -242,77 +399,180 @@ private:
         }
     }
 
-    std::string RenderValue(const BoundValue& value) const {
-        switch (value.type) {
-        case BoundValue::Type::Int:
-            return std::to_string(value.intValue);
-        case BoundValue::Type::Text:
-            return "'" + EscapeString(handle_, value.textValue) + "'";
-        case BoundValue::Type::Blob:
-            return BlobToHex(value.blobValue.data(), value.blobValue.size());
-        case BoundValue::Type::None:
-            return "NULL";
+    const Column& GetColumn(int index) const {
+        if (index < 0 || static_cast<size_t>(index) >= columns_.size()) {
+            throw DatabaseException("mariadb", 0, "invalid column index");
         }
-        return "NULL";
+        return columns_[index];
     }
 
-    void Execute() {
-        std::vector<std::string> rendered;
-        rendered.reserve(boundValues_.size());
-        for (const auto& value : boundValues_) {
-            rendered.push_back(RenderValue(value));
-        }
-
-        std::string sql;
-        sql.reserve(normalizedSql_.sql.size() + 64);
-        size_t parameterIndex = 0;
-        for (char c : normalizedSql_.sql) {
-            if (c == '?') {
-                if (parameterIndex >= normalizedSql_.logicalIndexByPosition.size()) {
-                    throw DatabaseException("mariadb", 0, "missing parameter value");
-                }
-                int logicalIndex = normalizedSql_.logicalIndexByPosition[parameterIndex++];
-                sql += rendered[static_cast<size_t>(logicalIndex)];
+    void BindParameters() {
+        const auto& positions = entry_.normalized.logicalIndexByPosition;
+        parameters_.assign(positions.size(), MYSQL_BIND{});
+
+        for (size_t position = 0; position < positions.size(); ++position) {
+            auto& value = boundValues_[static_cast<size_t>(positions[position])];
+            auto& bind = parameters_[position];
+
+            switch (value.type) {
+            case BoundValue::Type::Int:
+                bind.buffer_type = MYSQL_TYPE_LONGLONG;
+                bind.buffer = &value.intValue;
+                break;
+            case BoundValue::Type::Text:
+            case BoundValue::Type::Blob:
+                value.length = static_cast<unsigned long>(value.bytes.size());
+                bind.buffer_type = value.type == BoundValue::Type::Text ? MYSQL_TYPE_STRING
+                                                                        : MYSQL_TYPE_BLOB;
+                bind.buffer = value.bytes.data();
+                bind.buffer_length = value.length;
+                bind.length = &value.length;
+                break;
+            case BoundValue::Type::None:
+                bind.buffer_type = MYSQL_TYPE_NULL;
+                break;
+            }
+        }
+
+        if (!parameters_.empty() && mysql_stmt_bind_param(stmt_, parameters_.data()) != 0) {
+            throw MakeMariaDbStatementError(stmt_, "bind parameters failed");
+        }
+
+        for (size_t position = 0; position < positions.size(); ++position) {
+            const auto& value = boundValues_[static_cast<size_t>(positions[position])];
+            if (value.type == BoundValue::Type::Blob && value.bytes.size() > kLongDataThreshold) {
+                SendLongData(static_cast<unsigned int>(position), value.bytes);
+            }
+        }
+    }
+
+    void SendLongData(unsigned int position, const std::vector<char>& bytes) {
+        for (size_t offset = 0; offset < bytes.size(); offset += kLongDataChunkSize) {
+            auto chunk = std::min(kLongDataChunkSize, bytes.size() - offset);
+            if (mysql_stmt_send_long_data(stmt_, position, bytes.data() + offset,
+                    static_cast<unsigned long>(chunk)) != 0) {
+                throw MakeMariaDbStatementError(stmt_, "send long data failed");
+            }
+        }
+    }
+
+    void BindResults() {
+        if (!streaming_ && mysql_stmt_store_result(stmt_) != 0) {
+            throw MakeMariaDbStatementError(stmt_, "store result failed");
+        }
+
+        // Field max_length is only known once the result is stored, which lets every column
+        // buffer be sized exactly rather than fetching each value a second time. Streamed
+        // columns start from the declared length, capped, and grow on truncation.
+        auto metadata = mysql_stmt_result_metadata(stmt_);
+        if (!metadata) {
+            throw MakeMariaDbStatementError(stmt_, "result metadata failed");
+        }
+
+        auto fieldCount = mysql_num_fields(metadata);
+        auto fields = mysql_fetch_fields(metadata);
+
+        columns_.resize(fieldCount);
+        results_.assign(fieldCount, MYSQL_BIND{});
+
+        for (unsigned int i = 0; i < fieldCount; ++i) {
+            auto& column = columns_[i];
+            auto& bind = results_[i];
+            auto fieldType = static_cast<enum_field_types>(fields[i].type);
+
+            column.isInteger = IsIntegerField(fieldType);
+            if (column.isInteger) {
+                bind.buffer_type = MYSQL_TYPE_LONGLONG;
+                bind.buffer = &column.intValue;
             } else {
-                sql.push_back(c);
+                auto length = streaming_
+                    ? std::min<unsigned long>(fields[i].length, kStreamingColumnBufferSize)
+                    : fields[i].max_length;
+                column.buffer.resize(std::max<unsigned long>(length, 1));
+                bind.buffer_type = IsBlobField(fieldType) ? MYSQL_TYPE_BLOB : MYSQL_TYPE_STRING;
+                bind.buffer = column.buffer.data();
+                bind.buffer_length = static_cast<unsigned long>(column.buffer.size());
+                bind.length = &column.length;
             }
+
+            bind.is_null = &column.isNull;
+            bind.error = &column.error;
+        }
+
+        mysql_free_result(metadata);
+
+        if (mysql_stmt_bind_result(stmt_, results_.data()) != 0) {
+            throw MakeMariaDbStatementError(stmt_, "bind result failed");
+        }
+    }
+
+    void FetchTruncatedColumns() {
+        bool grown = false;
+
+        for (size_t i = 0; i < columns_.size(); ++i) {
+            auto& column = columns_[i];
+            if (column.isInteger || column.isNull || column.length <= column.buffer.size()) {
+                continue;
+            }
+
+            column.buffer.resize(column.length);
+            results_[i].buffer = column.buffer.data();
+            results_[i].buffer_length = static_cast<unsigned long>(column.buffer.size());
+
+            if (mysql_stmt_fetch_column(stmt_, &results_[i], static_cast<unsigned int>(i), 0) != 0) {
+                throw MakeMariaDbStatementError(stmt_, "fetch column failed");
+            }
+
+            grown = true;
         }
 
+        // Later rows are fetched straight into the grown buffers.
+        if (grown && mysql_stmt_bind_result(stmt_, results_.data()) != 0) {
+            throw MakeMariaDbStatementError(stmt_, "bind result failed");
+        }
+    }
+
+    void Execute() {
         for (int attempt = 0; attempt < 2; ++attempt) {
-            if (mysql_real_query(handle_, sql.c_str(), sql.size()) == 0) {
+            BindParameters();
+
+            if (mysql_stmt_execute(stmt_) == 0) {
                 break;
             }
 
-            const unsigned int code = mysql_errno(handle_);
-            if (attempt == 0 && IsConnectionLossError(code) && mysql_ping(handle_) == 0) {
-                ConfigureSession(handle_);
+            const unsigned int code = mysql_stmt_errno(stmt_);
+            if (attempt == 0 && IsConnectionLossError(code)
+                && mysql_ping(session_->Handle()) == 0) {
+                session_->Reconnected();
+
+                mysql_stmt_close(stmt_);
+                stmt_ = session_->Acquire(entry_);
+                generation_ = session_->Generation();
                 continue;
             }
 
-            throw MakeMariaDbError(handle_, code, "query failed");
+            throw MakeMariaDbStatementError(stmt_, "execute failed");
         }
 
-        result_ = mysql_store_result(handle_);
-        if (!result_ && mysql_field_count(handle_) != 0) {
-            throw MakeMariaDbError(handle_, mysql_errno(handle_), "store result failed");
-        }
-
-        if (result_) {
-            rowCount_ = mysql_num_rows(result_);
+        if (mysql_stmt_field_count(stmt_) > 0) {
+            BindResults();
+        } else {
+            session_->SetLastInsertId(mysql_stmt_insert_id(stmt_));
         }
 
         executed_ = true;
     }
 
-    MYSQL* handle_;
+    std::shared_ptr<MariaDbSession> session_;
+    MariaDbSession::CachedSql& entry_;
+    MYSQL_STMT* stmt_;
+    uint64_t generation_;
     bool executed_;
-    NormalizedSql normalizedSql_;
+    bool streaming_;
     std::vector<BoundValue> boundValues_;
-    MYSQL_RES* result_ = nullptr;
-    MYSQL_ROW currentRow_ = nullptr;
-    unsigned long* currentLengths_ = nullptr;
-    my_ulonglong rowIndex_;
-    my_ulonglong rowCount_ = 0;
+    std::vector<MYSQL_BIND> parameters_;
+    std::vector<Column> columns_;
+    std::vector<MYSQL_BIND> results_;
 };
 
 class MariaDbTransaction final : public ITransaction {
@@ -357,6 +617,7 @@ private:
 
 struct MariaDbDatabaseConnection::Impl {
     MYSQL* handle = nullptr;
+    std::shared_ptr<MariaDbSession> session;
 };
 
 MariaDbDatabaseConnection::MariaDbDatabaseConnection(const std::string& host, uint16_t port,
@@ -364,7 +625,7 @@ MariaDbDatabaseConnection::MariaDbDatabaseConnection(const std::string& host, ui
     const std::string& sslMode, const std::string& sslCa, const std::string& sslCaPath,
     const std::string& sslCert, const std::string& sslKey)
     : impl_{std::make_unique<Impl>()}
-    , capabilities_{UpsertStrategy::InsertIgnore, BlobSemantics::HexEncodedLiteral, TransactionIsolationSupport::ReadCommitted} {
+    , capabilities_{UpsertStrategy::InsertIgnore, BlobSemantics::NativeBlob, TransactionIsolationSupport::ReadCommitted} {
     impl_->handle = mysql_init(nullptr);
     if (!impl_->handle) {
         throw DatabaseException("mariadb", 0, "init failed");
@@ -390,16 +651,16 @@ MariaDbDatabaseConnection::MariaDbDatabaseConnection(const std::string& host, ui
     }
 
     ConfigureSession(impl_->handle);
-}
 
-MariaDbDatabaseConnection::~MariaDbDatabaseConnection() {
-    if (impl_ && impl_->handle) {
-        mysql_close(impl_->handle);
-    }
+    // The session owns the handle from here on and closes it once the connection and any
+    // statements still holding it are gone.
+    impl_->session = std::make_shared<MariaDbSession>(impl_->handle);
 }
 
+MariaDbDatabaseConnection::~MariaDbDatabaseConnection() = default;
+
 std::unique_ptr<IStatement> MariaDbDatabaseConnection::Prepare(const std::string& sql) {
-    return std::make_unique<MariaDbStatement>(impl_->handle, sql);
+    return std::make_unique<MariaDbStatement>(impl_->session, sql);
 }
 
 std::unique_ptr<ITransaction> MariaDbDatabaseConnection::BeginTransaction() {
@@ -407,9 +668,29 @@ std::unique_ptr<ITransaction> MariaDbDatabaseConnection::BeginTransaction() {
 }
 
 uint64_t MariaDbDatabaseConnection::GetLastInsertId() const {
-    return static_cast<uint64_t>(mysql_insert_id(impl_->handle));
+    return impl_->session->GetLastInsertId();
 }
 
 std::string MariaDbDatabaseConnection::BackendName() const { return "mariadb"; }
 
 const DatabaseCapabilities& MariaDbDatabaseConnection::Capabilities() const { return capabilities_; }
+
+bool MariaDbDatabaseConnection::Ping() {
+    auto threadId = mysql_thread_id(impl_->handle);
+
+    if (mysql_ping(impl_->handle) != 0) {
+        return false;
+    }
+
+    // A changed thread id means mysql_ping reconnected, which loses the session settings and
+    // every server-side prepared statement.
+    if (mysql_thread_id(impl_->handle) != threadId) {
+        try {
+            impl_->session->Reconnected();
+        } catch (const DatabaseException&) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -15,6 +15,7 @@ public:
     uint64_t GetLastInsertId() const override;
     std::string BackendName() const override;
     const DatabaseCapabilities& Capabilities() const override;
+    bool Ping() override;
 
 private:
     struct Impl;
@@ -0,0 +1,83 @@
+#include "DatabaseWorkerPool.hpp"
+#include "Database.hpp"
+
+#include <easylogging++.h>
+
+DatabaseWorkerPool::DatabaseWorkerPool(DatabaseConnectionPool& connections, size_t threadCount)
+    : connections_{connections} {
+    CHECK(threadCount > 0) << "database worker pool requires at least one thread";
+
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers_.emplace_back(&DatabaseWorkerPool::Run, this);
+    }
+}
+
+DatabaseWorkerPool::~DatabaseWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+
+    workAvailable_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t DatabaseWorkerPool::Pump() {
+    std::deque<std::function<void()>> completed;
+
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        completed.swap(completed_);
+    }
+
+    for (auto& continuation : completed) {
+        continuation();
+    }
+
+    return completed.size();
+}
+
+void DatabaseWorkerPool::SetCompletionHandler(std::function<void()> handler) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    completionHandler_ = std::move(handler);
+}
+
+void DatabaseWorkerPool::Post(
+    std::function<void(DatabaseConnectionPool&)> work, std::function<void()> continuation) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        pending_.push_back(Job{std::move(work), std::move(continuation)});
+    }
+
+    workAvailable_.notify_one();
+}
+
+void DatabaseWorkerPool::Run() {
+    std::unique_lock<std::mutex> lock{mutex_};
+
+    while (true) {
+        workAvailable_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+
+        if (stopping_) {
+            break;
+        }
+
+        auto job = std::move(pending_.front());
+        pending_.pop_front();
+
+        lock.unlock();
+        // Submit wraps the work so that its exceptions, and a failure to lease a connection,
+        // are captured in the promise.
+        job.work(connections_);
+        lock.lock();
+
+        completed_.push_back(std::move(job.continuation));
+
+        if (completionHandler_) {
+            completionHandler_();
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "DatabaseConnectionPool.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class IDatabaseConnection;
+
+/** Runs database reads on worker threads and hands their results back to the tick thread.
+*
+* Workers lease a connection from a DatabaseConnectionPool for each piece of work. Work
+* submitted to the pool runs on whichever worker is free and must only touch the connection it
+* is given and state that is safe to share between threads; its
+* continuation runs on the thread calling Pump, which is where the in-memory services may be
+* used again. Continuations receive a future so that an exception thrown by the work is
+* rethrown where the result is consumed.
+*/
+class DatabaseWorkerPool {
+public:
+    DatabaseWorkerPool(DatabaseConnectionPool& connections, size_t threadCount);
+
+    /** Stops the workers once their current job is done; queued jobs and completions are
+    * discarded.
+    */
+    ~DatabaseWorkerPool();
+
+    DatabaseWorkerPool(const DatabaseWorkerPool&) = delete;
+    DatabaseWorkerPool& operator=(const DatabaseWorkerPool&) = delete;
+
+    template <typename WorkT, typename ContinuationT>
+    void Submit(WorkT work, ContinuationT continuation) {
+        using ResultT = decltype(work(std::declval<IDatabaseConnection&>()));
+
+        auto promise = std::make_shared<std::promise<ResultT>>();
+        auto future = std::make_shared<std::future<ResultT>>(promise->get_future());
+
+        Post([promise, work](DatabaseConnectionPool& connections) mutable {
+            try {
+                auto db = connections.Lease();
+                promise->set_value(work(*db));
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        },
+            [future, continuation]() mutable { continuation(std::move(*future)); });
+    }
+
+    /** Runs the continuations of completed work on the calling thread; returns how many ran. */
+    size_t Pump();
+
+    /** Called on the worker thread each time work completes, e.g. to wake the thread that
+    * calls Pump.
+    */
+    void SetCompletionHandler(std::function<void()> handler);
+
+    size_t GetWorkerCount() const { return workers_.size(); }
+
+private:
+    struct Job {
+        std::function<void(DatabaseConnectionPool&)> work;
+        std::function<void()> continuation;
+    };
+
+    void Post(std::function<void(DatabaseConnectionPool&)> work, std::function<void()> continuation);
+    void Run();
+
+    DatabaseConnectionPool& connections_;
+
+    std::mutex mutex_;
+    std::condition_variable workAvailable_;
+    std::deque<Job> pending_;
+    std::deque<std::function<void()>> completed_;
+    std::function<void()> completionHandler_;
+    bool stopping_ = false;
+
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ChatEnums.hpp"
+#include "Database.hpp"
+
+#include "easylogging++.h"
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+
+/** Response to a request whose handler finishes after it returns, typically once a
+* DatabaseWorkerPool continuation runs.
+*
+* Copies share one response. Complete fills it in, reporting ChatResultException,
+* DatabaseException and any other std::exception through the result code exactly as a
+* synchronous handler would, and sends it at most once. If the client has disconnected in the meantime the response is dropped.
+*/
+template <typename ResponseT>
+class DeferredResponse {
+public:
+    DeferredResponse(uint32_t track, std::function<void(const ResponseT&)> send)
+        : state_{std::make_shared<State>(track, std::move(send))} {}
+
+    ResponseT& Get() { return state_->response; }
+
+    template <typename FillT>
+    void Complete(FillT fill) {
+        if (state_->completed) {
+            return;
+        }
+
+        try {
+            fill(state_->response);
+        } catch (const ChatResultException& e) {
+            state_->response.result = e.code;
+            LOG(ERROR) << "ChatAPI Result Exception: [" << ToString(e.code) << "] " << e.message;
+        } catch (const DatabaseException& e) {
+            state_->response.result = ChatResultCode::DATABASE;
+            LOG(ERROR) << "Database Error: [" << e.Backend() << ":" << e.Code() << "] " << e.what();
+        } catch (const std::exception& e) {
+            state_->response.result = ChatResultCode::DATABASE;
+            LOG(ERROR) << "Unhandled Exception: " << e.what();
+        }
+
+        state_->completed = true;
+        state_->send(state_->response);
+    }
+
+    void Complete() {
+        Complete([](ResponseT&) {});
+    }
+
+private:
+    struct State {
+        State(uint32_t track, std::function<void(const ResponseT&)> send_)
+            : response{track}
+            , send{std::move(send_)} {}
+
+        ResponseT response;
+        std::function<void(const ResponseT&)> send;
+        bool completed = false;
+    };
+
+    std::shared_ptr<State> state_;
+};
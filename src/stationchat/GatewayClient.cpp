@@ -46,115 +46,113 @@
 #include "easylogging++.h"
 
 GatewayClient::GatewayClient(UdpConnection* connection, GatewayNode* node)
-    : NodeClient(connection)
+    : NodeClient(connection, node->GetNetworkIo())
     , node_{node}
     , avatarService_{node->GetAvatarService()}
     , roomService_{node->GetRoomService()}
-    , messageService_{node->GetMessageService()} {
-    connection->SetHandler(this);
-}
+    , messageService_{node->GetMessageService()} {}
 
 GatewayClient::~GatewayClient() {}
 
-void GatewayClient::OnIncoming(std::istringstream& istream) {
-    ChatRequestType request_type = ::read<ChatRequestType>(istream);
+void GatewayClient::OnIncoming(BinaryReader& reader) {
+    ChatRequestType request_type = ::read<ChatRequestType>(reader);
 
     switch (request_type) {
     case ChatRequestType::LOGINAVATAR:
-        HandleIncomingMessage<LoginAvatar>(istream);
+        HandleIncomingMessage<LoginAvatar>(reader);
         break;
     case ChatRequestType::LOGOUTAVATAR:
-        HandleIncomingMessage<LogoutAvatar>(istream);
+        HandleIncomingMessage<LogoutAvatar>(reader);
         break;
     case ChatRequestType::CREATEROOM:
-        HandleIncomingMessage<CreateRoom>(istream);
+        HandleIncomingMessage<CreateRoom>(reader);
         break;
     case ChatRequestType::DESTROYROOM:
-        HandleIncomingMessage<DestroyRoom>(istream);
+        HandleIncomingMessage<DestroyRoom>(reader);
         break;
     case ChatRequestType::SENDINSTANTMESSAGE:
-        HandleIncomingMessage<SendInstantMessage>(istream);
+        HandleIncomingMessage<SendInstantMessage>(reader);
         break;
     case ChatRequestType::SENDROOMMESSAGE:
-        HandleIncomingMessage<SendRoomMessage>(istream);
+        HandleIncomingMessage<SendRoomMessage>(reader);
         break;
     case ChatRequestType::ADDFRIEND:
-        HandleIncomingMessage<AddFriend>(istream);
+        HandleIncomingMessage<AddFriend>(reader);
         break;
     case ChatRequestType::REMOVEFRIEND:
-        HandleIncomingMessage<RemoveFriend>(istream);
+        HandleIncomingMessage<RemoveFriend>(reader);
         break;
     case ChatRequestType::FRIENDSTATUS:
-        HandleIncomingMessage<FriendStatus>(istream);
+        HandleIncomingMessage<FriendStatus>(reader);
         break;
     case ChatRequestType::ADDIGNORE:
-        HandleIncomingMessage<AddIgnore>(istream);
+        HandleIncomingMessage<AddIgnore>(reader);
         break;
     case ChatRequestType::REMOVEIGNORE:
-        HandleIncomingMessage<RemoveIgnore>(istream);
+        HandleIncomingMessage<RemoveIgnore>(reader);
         break;
     case ChatRequestType::ENTERROOM:
-        HandleIncomingMessage<EnterRoom>(istream);
+        HandleIncomingMessage<EnterRoom>(reader);
         break;
     case ChatRequestType::LEAVEROOM:
-        HandleIncomingMessage<LeaveRoom>(istream);
+        HandleIncomingMessage<LeaveRoom>(reader);
         break;
     case ChatRequestType::ADDMODERATOR:
-        HandleIncomingMessage<AddModerator>(istream);
+        HandleIncomingMessage<AddModerator>(reader);
         break;
     case ChatRequestType::REMOVEMODERATOR:
-        HandleIncomingMessage<RemoveModerator>(istream);
+        HandleIncomingMessage<RemoveModerator>(reader);
         break;
     case ChatRequestType::ADDBAN:
-        HandleIncomingMessage<AddBan>(istream);
+        HandleIncomingMessage<AddBan>(reader);
         break;
     case ChatRequestType::REMOVEBAN:
-        HandleIncomingMessage<RemoveBan>(istream);
+        HandleIncomingMessage<RemoveBan>(reader);
         break;
     case ChatRequestType::ADDINVITE:
-        HandleIncomingMessage<AddInvite>(istream);
+        HandleIncomingMessage<AddInvite>(reader);
         break;
     case ChatRequestType::REMOVEINVITE:
-        HandleIncomingMessage<RemoveInvite>(istream);
+        HandleIncomingMessage<RemoveInvite>(reader);
         break;
     case ChatRequestType::KICKAVATAR:
-        HandleIncomingMessage<KickAvatar>(istream);
+        HandleIncomingMessage<KickAvatar>(reader);
         break;
     case ChatRequestType::GETROOM:
-        HandleIncomingMessage<GetRoom>(istream);
+        HandleIncomingMessage<GetRoom>(reader);
         break;
     case ChatRequestType::GETROOMSUMMARIES:
-        HandleIncomingMessage<GetRoomSummaries>(istream);
+        HandleIncomingMessage<GetRoomSummaries>(reader);
         break;
     case ChatRequestType::SENDPERSISTENTMESSAGE:
-        HandleIncomingMessage<SendPersistentMessage>(istream);
+        HandleIncomingMessage<SendPersistentMessage>(reader);
         break;
     case ChatRequestType::GETPERSISTENTHEADERS:
-        HandleIncomingMessage<GetPersistentHeaders>(istream);
+        HandleDeferredMessage<GetPersistentHeaders>(reader);
         break;
     case ChatRequestType::GETPERSISTENTMESSAGE:
-        HandleIncomingMessage<GetPersistentMessage>(istream);
+        HandleDeferredMessage<GetPersistentMessage>(reader);
         break;
     case ChatRequestType::UPDATEPERSISTENTMESSAGE:
-        HandleIncomingMessage<UpdatePersistentMessage>(istream);
+        HandleIncomingMessage<UpdatePersistentMessage>(reader);
         break;
     case ChatRequestType::UPDATEPERSISTENTMESSAGES:
-        HandleIncomingMessage<UpdatePersistentMessages>(istream);
+        HandleIncomingMessage<UpdatePersistentMessages>(reader);
         break;
     case ChatRequestType::IGNORESTATUS:
-        HandleIncomingMessage<IgnoreStatus>(istream);
+        HandleIncomingMessage<IgnoreStatus>(reader);
         break;
     case ChatRequestType::FAILOVER_RELOGINAVATAR:
-        HandleIncomingMessage<FailoverReLoginAvatar>(istream);
+        HandleIncomingMessage<FailoverReLoginAvatar>(reader);
         break;
     case ChatRequestType::SETAPIVERSION:
-        HandleIncomingMessage<SetApiVersion>(istream);
+        HandleIncomingMessage<SetApiVersion>(reader);
         break;
     case ChatRequestType::SETAVATARATTRIBUTES:
-        HandleIncomingMessage<SetAvatarAttributes>(istream);
+        HandleIncomingMessage<SetAvatarAttributes>(reader);
         break;
     case ChatRequestType::GETANYAVATAR:
-        HandleIncomingMessage<GetAnyAvatar>(istream);
+        HandleDeferredMessage<GetAnyAvatar>(reader);
         break;
     default:
         LOG(INFO) << "Unknown request type received: " << static_cast<uint16_t>(request_type);
@@ -170,37 +168,29 @@ void GatewayClient::SendFriendLoginUpdate(
 }
 
 void GatewayClient::SendFriendLoginUpdates(const ChatAvatar* avatar) {
-    auto as = node_->GetAvatarService();
-    auto& onlineAvatars = as->GetOnlineAvatars();
-    for (auto onlineAvatar : onlineAvatars) {
-        if (onlineAvatar->IsFriend(avatar)) {
-            SendFriendLoginUpdate(onlineAvatar, avatar);
-        }
+    for (auto onlineAvatar : avatarService_->GetOnlineAvatarsWithFriend(avatar->GetAvatarId())) {
+        SendFriendLoginUpdate(onlineAvatar, avatar);
     }
 
     for (auto& contact : avatar->GetFriendList()) {
-        if (contact.frnd->IsOnline()) {
-            Send(MFriendLogin{contact.frnd, contact.frnd->GetAddress(), avatar->GetAvatarId(),
-                contact.frnd->GetStatusMessage()});
+        auto onlineFriend = avatarService_->GetOnlineAvatar(contact.avatarId);
+        if (onlineFriend) {
+            Send(MFriendLogin{onlineFriend, onlineFriend->GetAddress(), avatar->GetAvatarId(),
+                onlineFriend->GetStatusMessage()});
         }
     }
 }
 
 void GatewayClient::SendFriendLogoutUpdates(const ChatAvatar* avatar) {
-    auto& onlineAvatars = avatarService_->GetOnlineAvatars();
-    for (auto onlineAvatar : onlineAvatars) {
-        if (onlineAvatar->IsFriend(avatar)) {
-            node_->SendTo(onlineAvatar->GetAddress(),
-                MFriendLogout{avatar, avatar->GetAddress(), onlineAvatar->GetAvatarId()});
-        }
+    for (auto onlineAvatar : avatarService_->GetOnlineAvatarsWithFriend(avatar->GetAvatarId())) {
+        node_->SendTo(onlineAvatar->GetAddress(),
+            MFriendLogout{avatar, avatar->GetAddress(), onlineAvatar->GetAvatarId()});
     }
 }
 
 void GatewayClient::SendDestroyRoomUpdate(
     const ChatAvatar* srcAvatar, uint32_t roomId, std::vector<std::u16string> targets) {
-    for (auto& address : targets) {
-        node_->SendTo(address, MDestroyRoom{srcAvatar, roomId});
-    }
+    node_->SendTo(targets, MDestroyRoom{srcAvatar, roomId});
 }
 
 void GatewayClient::SendInstantMessageUpdate(const ChatAvatar* srcAvatar,
@@ -211,24 +201,20 @@ void GatewayClient::SendInstantMessageUpdate(const ChatAvatar* srcAvatar,
 
 void GatewayClient::SendRoomMessageUpdate(const ChatAvatar* srcAvatar, const ChatRoom* room,
     uint32_t messageId, const std::u16string& message, const std::u16string& oob) {
-    auto connectedAddresses = room->GetConnectedAddresses();
-    for (auto& address : connectedAddresses) {
-        node_->SendTo(address, MRoomMessage{srcAvatar, room->GetRoomId(), room->GetAvatarIds(srcAvatar),
-                                   message, oob, messageId});
-    }
+    // Every gateway receives the same recipient list, so the message is filtered and encoded
+    // once and the bytes are reused for each connected address.
+    node_->SendTo(room->GetConnectedAddresses(),
+        MRoomMessage{srcAvatar, room->GetRoomId(), room->GetAvatarIds(srcAvatar), message, oob,
+            messageId});
 }
 
 void GatewayClient::SendEnterRoomUpdate(const ChatAvatar* srcAvatar, const ChatRoom* room) {
-    for (const auto& address : room->GetConnectedAddresses()) {
-        node_->SendTo(address, MEnterRoom{srcAvatar, room->GetRoomId()});
-    }
+    node_->SendTo(room->GetConnectedAddresses(), MEnterRoom{srcAvatar, room->GetRoomId()});
 }
 
 void GatewayClient::SendLeaveRoomUpdate(
     const std::vector<std::u16string>& addresses, uint32_t srcAvatarId, uint32_t roomId) {
-    for (const auto& address : addresses) {
-        node_->SendTo(address, MLeaveRoom{srcAvatarId, roomId});
-    }
+    node_->SendTo(addresses, MLeaveRoom{srcAvatarId, roomId});
 }
 
 void GatewayClient::SendPersistentMessageUpdate(
@@ -241,8 +227,6 @@ void GatewayClient::SendPersistentMessageUpdate(
 
 void GatewayClient::SendKickAvatarUpdate(const std::vector<std::u16string>& addresses,
     const ChatAvatar* srcAvatar, const ChatAvatar* destAvatar, const ChatRoom* room) {
-    for (const auto& address : addresses) {
-        node_->SendTo(address,
-            MKickAvatar{srcAvatar, destAvatar, room->GetRoomName(), room->GetRoomAddress()});
-    }
+    node_->SendTo(addresses,
+        MKickAvatar{srcAvatar, destAvatar, room->GetRoomName(), room->GetRoomAddress()});
 }
@@ -3,9 +3,13 @@
 
 #include "ChatEnums.hpp"
 #include "Database.hpp"
+#include "DeferredResponse.hpp"
 #include "NodeClient.hpp"
 #include "easylogging++.h"
 
+#include <exception>
+#include <memory>
+
 class ChatAvatar;
 class ChatAvatarService;
 class ChatRoom;
@@ -38,15 +42,15 @@ public:
     void SendKickAvatarUpdate(const std::vector<std::u16string>& addresses, const ChatAvatar* srcAvatar, const ChatAvatar* destAvatar, const ChatRoom* room);
 
 private:
-    void OnIncoming(std::istringstream& istream) override;
+    void OnIncoming(BinaryReader& reader) override;
 
-    template<typename HandlerT, typename StreamT>
-    void HandleIncomingMessage(StreamT& istream) {
+    template<typename HandlerT>
+    void HandleIncomingMessage(BinaryReader& reader) {
         typedef typename HandlerT::RequestType RequestT;
         typedef typename HandlerT::ResponseType ResponseT;
 
         RequestT request;
-        read(istream, request);
+        read(reader, request);
         ResponseT response(request.track);
 
         try {
@@ -57,10 +61,45 @@ private:
         } catch (const DatabaseException& e) {
             response.result = ChatResultCode::DATABASE;
             LOG(ERROR) << "Database Error: [" << e.Backend() << ":" << e.Code() << "] " << e.what();
+        } catch (const std::exception& e) {
+            response.result = ChatResultCode::DATABASE;
+            LOG(ERROR) << "Unhandled Exception: " << e.what();
         }
 
         Send(response);
     }
+
+    /** Like HandleIncomingMessage, for handlers that take a DeferredResponse and may send it
+    * after returning, once their database work completes.
+    */
+    template<typename HandlerT>
+    void HandleDeferredMessage(BinaryReader& reader) {
+        typedef typename HandlerT::RequestType RequestT;
+        typedef typename HandlerT::ResponseType ResponseT;
+
+        RequestT request;
+        read(reader, request);
+
+        std::weak_ptr<bool> lifetime = lifetimeToken_;
+        DeferredResponse<ResponseT> response{request.track, [this, lifetime](const ResponseT& data) {
+            if (lifetime.expired()) {
+                LOG(INFO) << "Dropping response for disconnected client, track: " << data.track;
+                return;
+            }
+
+            Send(data);
+        }};
+
+        try {
+            HandlerT(this, request, response);
+        } catch (...) {
+            // Report a handler that failed before deferring the same way a synchronous one is.
+            response.Complete([](ResponseT&) { throw; });
+        }
+    }
+
+    // Expires with the client; deferred responses check it before sending.
+    std::shared_ptr<bool> lifetimeToken_ = std::make_shared<bool>(true);
     
     GatewayNode* node_;
     ChatAvatarService* avatarService_;
@@ -2,19 +2,47 @@
 
 #include "ChatAvatarService.hpp"
 #include "ChatRoomService.hpp"
+#include "DatabaseConnectionPool.hpp"
 #include "DatabaseFactory.hpp"
+#include "DatabaseWorkerPool.hpp"
+#include "PersistenceQueue.hpp"
 #include "PersistentMessageService.hpp"
 #include "StationChatConfig.hpp"
 #include "policy/PolicyEngine.hpp"
 
+#include <easylogging++.h>
+
+#include <algorithm>
+
+namespace {
+const std::chrono::seconds kStatsReportInterval{60};
+} // namespace
+
 GatewayNode::GatewayNode(StationChatConfig& config)
-    : Node(this, config.gatewayAddress, config.gatewayPort, config.bindToIp)
+    : Node(this, config.gatewayAddress, config.gatewayPort, config.bindToIp,
+          NetworkIoOptions{config.networkIoThread, config.networkQueueCapacity})
     , config_{config}
-    , db_{CreateDatabaseConnection(config)} {
-    avatarService_ = std::make_unique<ChatAvatarService>(db_.get());
-    roomService_ = std::make_unique<ChatRoomService>(avatarService_.get(), db_.get());
-    messageService_ = std::make_unique<PersistentMessageService>(db_.get());
+    , db_{CreateDatabaseConnection(config)}
+    , lastStatsReport_{std::chrono::steady_clock::now()} {
+    SetCoalesceWindow(std::chrono::microseconds{config_.outboundCoalesceWindowUs});
+
+    if (config_.databaseWriteBehind) {
+        persistenceQueue_ = std::make_unique<PersistenceQueue>(CreateDatabaseConnection(config_));
+    }
+
+    avatarService_ = std::make_unique<ChatAvatarService>(
+        db_.get(), config_.avatarCacheCapacity, persistenceQueue_.get());
+    roomService_ = std::make_unique<ChatRoomService>(
+        avatarService_.get(), db_.get(), persistenceQueue_.get());
+    messageService_ = std::make_unique<PersistentMessageService>(db_.get(), persistenceQueue_.get());
     policyEngine_ = std::make_unique<policy::PolicyEngine>(config_);
+
+    // Only the worker threads lease from the pool, one connection each; the services above
+    // keep running their synchronous queries on db_.
+    const auto workerThreads = std::max(config_.databaseWorkerThreads, 1u);
+    connectionPool_ = std::make_unique<DatabaseConnectionPool>(
+        [this]() { return CreateDatabaseConnection(config_); }, workerThreads);
+    databaseWorkers_ = std::make_unique<DatabaseWorkerPool>(*connectionPool_, workerThreads);
 }
 
 GatewayNode::~GatewayNode() = default;
@@ -27,6 +55,8 @@ PersistentMessageService* GatewayNode::GetMessageService() {
     return messageService_.get();
 }
 
+DatabaseWorkerPool* GatewayNode::GetDatabaseWorkers() { return databaseWorkers_.get(); }
+
 StationChatConfig& GatewayNode::GetConfig() { return config_; }
 
 policy::PolicyEngine* GatewayNode::GetPolicyEngine() {
@@ -37,4 +67,50 @@ void GatewayNode::RegisterClientAddress(const std::u16string & address, GatewayC
     clientAddressMap_[address] = client;
 }
 
-void GatewayNode::OnTick() {}
+void GatewayNode::OnTick() {
+    // Continuations may cache avatars, so they run before eviction.
+    databaseWorkers_->Pump();
+    avatarService_->EvictAvatars();
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastStatsReport_ < kStatsReportInterval) {
+        return;
+    }
+
+    lastStatsReport_ = now;
+
+    auto poolStats = connectionPool_->GetStats();
+    LOG(INFO) << "Database pool: size " << poolStats.size << ", idle " << poolStats.idle
+              << ", leases " << poolStats.leases << ", waits " << poolStats.waits
+              << ", total wait " << poolStats.totalWait.count() << "us, max wait "
+              << poolStats.maxWait.count() << "us, replaced " << poolStats.replaced;
+
+    const auto& avatarCache = avatarService_->GetCacheStats();
+    LOG(INFO) << "Avatar cache: size " << avatarService_->GetCachedAvatarCount() << ", hits "
+              << avatarCache.hits << ", misses " << avatarCache.misses << ", evictions "
+              << avatarCache.evictions;
+
+    const auto& outbound = GetOutboundStats();
+    if (outbound.batchFrames > 0) {
+        LOG(INFO) << "Outbound: packets " << outbound.packets << ", messages " << outbound.messages
+                  << ", batch frames " << outbound.batchFrames << ", messages per packet "
+                  << static_cast<double>(outbound.messages) / outbound.packets;
+    }
+
+    if (auto networkIo = GetNetworkIo()) {
+        auto stats = networkIo->GetStats();
+        LOG(INFO) << "Network queues: capacity " << stats.capacity << ", inbound depth "
+                  << stats.inboundDepth << ", outbound depth " << stats.outboundDepth
+                  << ", inbound dropped " << stats.inboundDropped << ", outbound dropped "
+                  << stats.outboundDropped;
+    }
+
+    if (persistenceQueue_) {
+        auto stats = persistenceQueue_->GetStats();
+        LOG(INFO) << "Persistence queue: depth " << stats.depth << ", enqueued " << stats.enqueued
+                  << ", coalesced " << stats.coalesced << ", executed " << stats.executed
+                  << ", retried " << stats.retried << ", failed " << stats.failed << ", last latency "
+                  << stats.lastFlushLatency.count() << "us, max latency "
+                  << stats.maxFlushLatency.count() << "us";
+    }
+}
@@ -1,15 +1,22 @@
 #pragma once
 
+#include "BinaryWriter.hpp"
 #include "Node.hpp"
 #include "GatewayClient.hpp"
 
+#include <chrono>
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 class ChatAvatarService;
 class ChatRoomService;
+class DatabaseConnectionPool;
+class DatabaseWorkerPool;
 class PersistentMessageService;
 class IDatabaseConnection;
+class PersistenceQueue;
 struct StationChatConfig;
 
 namespace policy {
@@ -24,6 +31,7 @@ public:
     ChatAvatarService* GetAvatarService();
     ChatRoomService* GetRoomService();
     PersistentMessageService* GetMessageService();
+    DatabaseWorkerPool* GetDatabaseWorkers();
     StationChatConfig& GetConfig();
     policy::PolicyEngine* GetPolicyEngine();
 
@@ -37,6 +45,12 @@ public:
         }
     }
 
+    /** Serializes message once and sends the same bytes to each of the given addresses. */
+    template<typename MessageT>
+    void SendTo(const std::vector<std::u16string>& addresses, const MessageT& message) {
+        SendToEach(fanoutWriter_, clientAddressMap_, addresses, message);
+    }
+
 private:
     void OnTick() override;
 
@@ -46,5 +60,13 @@ private:
     std::map<std::u16string, GatewayClient*> clientAddressMap_;
     StationChatConfig& config_;
     std::unique_ptr<IDatabaseConnection> db_;
+    // Null when database_write_behind is disabled; otherwise drained before db_ is closed.
+    std::unique_ptr<PersistenceQueue> persistenceQueue_;
     std::unique_ptr<policy::PolicyEngine> policyEngine_;
+    std::unique_ptr<DatabaseConnectionPool> connectionPool_;
+    // Declared after the services and connections its queued work refers to, so it is
+    // stopped first.
+    std::unique_ptr<DatabaseWorkerPool> databaseWorkers_;
+    BinaryWriter fanoutWriter_;
+    std::chrono::steady_clock::time_point lastStatsReport_;
 };
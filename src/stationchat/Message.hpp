@@ -6,6 +6,8 @@
 
 #include <cstdint>
 #include <string>
+#include <utility>
+#include <vector>
 
 enum class ChatMessageType : uint16_t {
     // ChatAvatar message types
@@ -100,7 +102,7 @@ struct MRoomMessage {
         const std::u16string& message_, const std::u16string& oob_, uint32_t messageId_)
         : srcAvatar{srcAvatar_}
         , roomId{roomId_}
-        , destList{destList_}
+        , destList{std::move(destList_)}
         , message{message_}
         , oob{oob_}
         , messageId{messageId_} {}
@@ -0,0 +1,309 @@
+#include "PersistenceQueue.hpp"
+#include "Database.hpp"
+
+#include <easylogging++.h>
+
+#include <algorithm>
+
+namespace {
+// A write that fails with a transient error is retried at the head of the queue forever,
+// backing off up to kMaxRetryDelay between attempts.
+const std::chrono::milliseconds kInitialRetryDelay{50};
+const std::chrono::milliseconds kMaxRetryDelay{5000};
+} // namespace
+
+PersistenceOp& PersistenceOp::BindInt(const std::string& name, int64_t value) {
+    params.push_back(PersistenceParam{name, PersistenceParam::Type::Int, value, {}});
+    return *this;
+}
+
+PersistenceOp& PersistenceOp::BindText(const std::string& name, const std::string& value) {
+    params.push_back(PersistenceParam{name, PersistenceParam::Type::Text, 0, value});
+    return *this;
+}
+
+void ExecutePersistenceOp(IDatabaseConnection& db, const PersistenceOp& op) {
+    StatementHandle stmt{db.Prepare(op.sql)};
+
+    for (auto& param : op.params) {
+        int index = stmt->BindParameterIndex(param.name);
+
+        if (param.type == PersistenceParam::Type::Int) {
+            stmt->BindInt(index, param.intValue);
+        } else {
+            stmt->BindText(index, param.textValue);
+        }
+    }
+
+    stmt.ExpectDone(op.sql);
+}
+
+void PersistOrExecute(IDatabaseConnection& db, PersistenceQueue* queue, PersistenceOp op) {
+    if (queue) {
+        queue->Enqueue(std::move(op));
+    } else {
+        ExecutePersistenceOp(db, op);
+    }
+}
+
+PersistenceQueue::PersistenceQueue(std::unique_ptr<IDatabaseConnection> db)
+    : db_{std::move(db)} {
+    CHECK_NOTNULL(db_.get());
+    worker_ = std::thread{&PersistenceQueue::Run, this};
+}
+
+PersistenceQueue::~PersistenceQueue() {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+
+    workAvailable_.notify_all();
+    worker_.join();
+}
+
+void PersistenceQueue::Enqueue(PersistenceOp op) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        ++stats_.enqueued;
+
+        if (!op.coalesceKey.empty() && Coalesce(op)) {
+            return;
+        }
+
+        auto sequence = nextSequence_++;
+        if (!op.coalesceKey.empty()) {
+            pendingByKey_[op.coalesceKey].push_back(sequence);
+        }
+
+        ++pendingByScope_[op.scope];
+        ++stats_.depth;
+        entries_.push_back(Entry{sequence, std::move(op), std::chrono::steady_clock::now(), false});
+    }
+
+    workAvailable_.notify_one();
+}
+
+void PersistenceQueue::Flush() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    workCompleted_.wait(lock, [this] { return entries_.empty() && !executing_; });
+}
+
+bool PersistenceQueue::Flush(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    return workCompleted_.wait_for(
+        lock, timeout, [this] { return entries_.empty() && !executing_; });
+}
+
+bool PersistenceQueue::HasPending(const std::string& scope) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto find_iter = pendingByScope_.find(scope);
+    return find_iter != std::end(pendingByScope_) && find_iter->second > 0;
+}
+
+std::unordered_set<std::string> PersistenceQueue::GetPendingScopes() const {
+    std::unordered_set<std::string> scopes;
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (const auto& pending : pendingByScope_) {
+        if (pending.second > 0) {
+            scopes.insert(pending.first);
+        }
+    }
+
+    return scopes;
+}
+
+void PersistenceQueue::WaitForScope(const std::string& scope) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    workCompleted_.wait(lock, [this, &scope] {
+        auto find_iter = pendingByScope_.find(scope);
+        return find_iter == std::end(pendingByScope_) || find_iter->second == 0;
+    });
+}
+
+bool PersistenceQueue::WaitForScope(const std::string& scope, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    return workCompleted_.wait_for(lock, timeout, [this, &scope] {
+        auto find_iter = pendingByScope_.find(scope);
+        return find_iter == std::end(pendingByScope_) || find_iter->second == 0;
+    });
+}
+
+PersistenceQueueStats PersistenceQueue::GetStats() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return stats_;
+}
+
+void PersistenceQueue::Run() {
+    std::unique_lock<std::mutex> lock{mutex_};
+
+    while (true) {
+        workAvailable_.wait(lock, [this] { return stopping_ || !entries_.empty(); });
+
+        if (entries_.empty()) {
+            // Only reached once stopping_ is set and everything queued has been written.
+            break;
+        }
+
+        auto entry = std::move(entries_.front());
+        entries_.pop_front();
+
+        if (entry.cancelled) {
+            workCompleted_.notify_all();
+            continue;
+        }
+
+        // Once it starts executing an entry can no longer be coalesced with later writes.
+        auto keyEntries = pendingByKey_.find(entry.op.coalesceKey);
+        if (keyEntries != std::end(pendingByKey_)) {
+            auto& sequences = keyEntries->second;
+            sequences.erase(std::remove(std::begin(sequences), std::end(sequences), entry.sequence),
+                std::end(sequences));
+
+            if (sequences.empty()) {
+                pendingByKey_.erase(keyEntries);
+            }
+        }
+
+        executing_ = true;
+        lock.unlock();
+
+        auto outcome = Execute(entry);
+
+        lock.lock();
+        executing_ = false;
+        Complete(entry, outcome == Outcome::Executed);
+
+        if (outcome == Outcome::Abandoned) {
+            // The database is still unreachable at shutdown and nothing outlives the process.
+            AbandonQueued();
+        }
+
+        workCompleted_.notify_all();
+    }
+}
+
+void PersistenceQueue::AbandonQueued() {
+    size_t abandoned = 1;
+
+    for (auto& entry : entries_) {
+        if (!entry.cancelled) {
+            Complete(entry, false);
+            ++abandoned;
+        }
+    }
+
+    entries_.clear();
+    pendingByKey_.clear();
+
+    LOG(ERROR) << "Database unreachable at shutdown, " << abandoned
+               << " queued write(s) were not applied";
+}
+
+PersistenceQueue::Outcome PersistenceQueue::Execute(const Entry& entry) {
+    auto retryDelay = kInitialRetryDelay;
+
+    for (uint64_t attempt = 1;; ++attempt) {
+        try {
+            ExecutePersistenceOp(*db_, entry.op);
+            return Outcome::Executed;
+        } catch (const DatabaseException& e) {
+            if (!IsTransientDatabaseError(e)) {
+                LOG(ERROR) << "Discarding write rejected by the database: " << e.what()
+                           << " [" << entry.op.sql << "]";
+                return Outcome::Rejected;
+            }
+
+            LOG_IF((attempt & (attempt - 1)) == 0, WARNING)
+                << "Write failed " << attempt << " time(s), retrying in " << retryDelay.count()
+                << "ms: " << e.what();
+        } catch (const std::exception& e) {
+            LOG(ERROR) << "Discarding write that cannot be executed: " << e.what()
+                       << " [" << entry.op.sql << "]";
+            return Outcome::Rejected;
+        }
+
+        std::unique_lock<std::mutex> lock{mutex_};
+        ++stats_.retried;
+
+        if (workAvailable_.wait_for(lock, retryDelay, [this] { return stopping_; })) {
+            return Outcome::Abandoned;
+        }
+
+        retryDelay = std::min(retryDelay * 2, kMaxRetryDelay);
+    }
+}
+
+void PersistenceQueue::Complete(const Entry& entry, bool succeeded) {
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - entry.enqueuedAt);
+
+    if (succeeded) {
+        ++stats_.executed;
+    } else {
+        ++stats_.failed;
+    }
+
+    --stats_.depth;
+    stats_.lastFlushLatency = latency;
+    stats_.maxFlushLatency = std::max(stats_.maxFlushLatency, latency);
+
+    ReleaseScope(entry.op.scope);
+}
+
+bool PersistenceQueue::Coalesce(const PersistenceOp& op) {
+    auto find_iter = pendingByKey_.find(op.coalesceKey);
+    if (find_iter == std::end(pendingByKey_)) {
+        return false;
+    }
+
+    auto& sequences = find_iter->second;
+    auto kindOf = [this](uint64_t sequence) {
+        return entries_[sequence - entries_.front().sequence].op.kind;
+    };
+
+    auto cancel = [this](uint64_t sequence) {
+        auto& entry = entries_[sequence - entries_.front().sequence];
+        entry.cancelled = true;
+        --stats_.depth;
+        ++stats_.coalesced;
+        ReleaseScope(entry.op.scope);
+    };
+
+    bool absorbed = false;
+
+    if (op.kind == PersistenceOpKind::Delete) {
+        // Deleting a row whose insert has not run yet: neither needs to reach the database,
+        // nor do any updates queued against the row in between.
+        auto insert = std::find_if(std::begin(sequences), std::end(sequences),
+            [&kindOf](uint64_t sequence) { return kindOf(sequence) == PersistenceOpKind::Insert; });
+
+        if (insert != std::end(sequences)) {
+            std::for_each(insert, std::end(sequences), cancel);
+            sequences.erase(insert, std::end(sequences));
+            ++stats_.coalesced;
+            absorbed = true;
+        }
+    } else if (op.kind == PersistenceOpKind::Update) {
+        // A later update of the same key rewrites the same rows, so only the last one runs.
+        auto updates = std::stable_partition(std::begin(sequences), std::end(sequences),
+            [&kindOf](uint64_t sequence) { return kindOf(sequence) != PersistenceOpKind::Update; });
+
+        std::for_each(updates, std::end(sequences), cancel);
+        sequences.erase(updates, std::end(sequences));
+    }
+
+    if (sequences.empty()) {
+        pendingByKey_.erase(find_iter);
+    }
+
+    return absorbed;
+}
+
+void PersistenceQueue::ReleaseScope(const std::string& scope) {
+    auto find_iter = pendingByScope_.find(scope);
+    if (--find_iter->second == 0) {
+        pendingByScope_.erase(find_iter);
+    }
+}
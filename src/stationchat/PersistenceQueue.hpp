@@ -0,0 +1,167 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class IDatabaseConnection;
+
+enum class PersistenceOpKind {
+    Insert,
+    Delete,
+    Update
+};
+
+struct PersistenceParam {
+    enum class Type {
+        Int,
+        Text
+    };
+
+    std::string name;
+    Type type;
+    int64_t intValue;
+    std::string textValue;
+};
+
+/** A single write, recorded as SQL with named parameters so it can run on any connection.
+*
+* Operations sharing a coalesceKey address the same row (or rows) and may be merged while
+* they are still queued; scope names the data a later read depends on (see WaitForScope).
+*/
+struct PersistenceOp {
+    PersistenceOpKind kind;
+    std::string sql;
+    std::vector<PersistenceParam> params;
+    std::string coalesceKey;
+    std::string scope;
+
+    PersistenceOp& BindInt(const std::string& name, int64_t value);
+    PersistenceOp& BindText(const std::string& name, const std::string& value);
+};
+
+/** Prepares, binds and executes op on db, throwing DatabaseException on failure. */
+void ExecutePersistenceOp(IDatabaseConnection& db, const PersistenceOp& op);
+
+class PersistenceQueue;
+
+/** Hands op to queue when write-behind is enabled, otherwise executes it on db immediately. */
+void PersistOrExecute(IDatabaseConnection& db, PersistenceQueue* queue, PersistenceOp op);
+
+struct PersistenceQueueStats {
+    size_t depth = 0;
+    uint64_t enqueued = 0;
+    uint64_t coalesced = 0;
+    uint64_t executed = 0;
+    uint64_t failed = 0;
+    // Attempts that failed with a transient error and were tried again.
+    uint64_t retried = 0;
+    // Time from enqueue until the write completed.
+    std::chrono::microseconds lastFlushLatency{0};
+    std::chrono::microseconds maxFlushLatency{0};
+};
+
+/** How long the tick thread waits on the queue before a delete that must follow the queued
+* writes fails instead. While the database is unreachable the queue does not drain at all.
+*/
+constexpr std::chrono::milliseconds kPersistenceWaitTimeout{2000};
+
+/** Ordered write-behind queue drained by a worker thread on its own database connection.
+*
+* Request handlers enqueue writes and return immediately; the worker executes them in
+* enqueue order. While queued, an insert followed by a delete of the same row cancels out
+* and a repeated update replaces the earlier one. A write that fails with a transient error
+* (see IsTransientDatabaseError) stays at the head of the queue and is retried with capped
+* backoff for as long as it takes, holding back everything queued behind it; a write the
+* database rejects outright is discarded with an error-level alert.
+*
+* The queue is not durable: it lives only in memory, so writes still queued when the process
+* exits or crashes are lost, as are those left unapplied when destruction finds the database
+* unreachable. Destruction otherwise drains the queue.
+*/
+class PersistenceQueue {
+public:
+    explicit PersistenceQueue(std::unique_ptr<IDatabaseConnection> db);
+    ~PersistenceQueue();
+
+    PersistenceQueue(const PersistenceQueue&) = delete;
+    PersistenceQueue& operator=(const PersistenceQueue&) = delete;
+
+    void Enqueue(PersistenceOp op);
+
+    /** Blocks until every write enqueued so far has been executed or discarded. */
+    void Flush();
+
+    /** Like Flush, but gives up after timeout; returns false if writes were still pending. */
+    bool Flush(std::chrono::milliseconds timeout);
+
+    bool HasPending(const std::string& scope) const;
+
+    /** Every scope with writes queued or executing, read under a single lock for callers that
+    * would otherwise ask HasPending for many scopes in a row.
+    */
+    std::unordered_set<std::string> GetPendingScopes() const;
+
+    /** Blocks until no write for scope is queued or executing, so a read issued afterwards
+    * observes them.
+    */
+    void WaitForScope(const std::string& scope);
+
+    /** Like WaitForScope, but gives up after timeout; returns false if writes for scope were
+    * still pending.
+    */
+    bool WaitForScope(const std::string& scope, std::chrono::milliseconds timeout);
+
+    PersistenceQueueStats GetStats() const;
+
+private:
+    struct Entry {
+        uint64_t sequence;
+        PersistenceOp op;
+        std::chrono::steady_clock::time_point enqueuedAt;
+        bool cancelled;
+    };
+
+    enum class Outcome {
+        Executed,
+        Rejected,
+        // Still failing when the queue was asked to stop.
+        Abandoned
+    };
+
+    void Run();
+    Outcome Execute(const Entry& entry);
+    void Complete(const Entry& entry, bool succeeded);
+    /** Gives up on every write still queued. Requires mutex_. */
+    void AbandonQueued();
+
+    /** Merges op with the writes still queued under its key; returns true if op itself is
+    * no longer needed. Requires mutex_.
+    */
+    bool Coalesce(const PersistenceOp& op);
+    void ReleaseScope(const std::string& scope);
+
+    std::unique_ptr<IDatabaseConnection> db_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable workCompleted_;
+    std::deque<Entry> entries_;
+    // Sequences of the queued, not yet executing, entries under each coalesce key.
+    std::unordered_map<std::string, std::vector<uint64_t>> pendingByKey_;
+    std::unordered_map<std::string, size_t> pendingByScope_;
+    uint64_t nextSequence_ = 0;
+    bool executing_ = false;
+    bool stopping_ = false;
+    PersistenceQueueStats stats_;
+
+    std::thread worker_;
+};
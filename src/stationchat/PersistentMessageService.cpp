@@ -1,11 +1,45 @@
 #include "PersistentMessageService.hpp"
 
 #include "Database.hpp"
+#include "PersistenceQueue.hpp"
 #include "StringUtils.hpp"
 
+#include <algorithm>
+#include <cstring>
 
-PersistentMessageService::PersistentMessageService(IDatabaseConnection* db)
-    : db_{db} {}
+namespace {
+std::string MessageScope(uint32_t avatarId) {
+    return "pm:" + std::to_string(avatarId);
+}
+
+/** Matches the status filter of the header query. */
+bool IsListedStatus(PersistentState status) {
+    return status == PersistentState::NEW || status == PersistentState::UNREAD
+        || status == PersistentState::READ;
+}
+
+/** Sets the status of the matching headers, removing those that are no longer listed. */
+template <typename PredicateT>
+void SetHeaderStatus(
+    std::vector<PersistentHeader>& headers, PredicateT matches, PersistentState status) {
+    if (!IsListedStatus(status)) {
+        headers.erase(std::remove_if(std::begin(headers), std::end(headers), matches),
+            std::end(headers));
+        return;
+    }
+
+    for (auto& header : headers) {
+        if (matches(header)) {
+            header.status = status;
+        }
+    }
+}
+} // namespace
+
+PersistentMessageService::PersistentMessageService(
+    IDatabaseConnection* db, PersistenceQueue* persistenceQueue)
+    : db_{db}
+    , persistenceQueue_{persistenceQueue} {}
 
 PersistentMessageService::~PersistentMessageService() {}
 
@@ -58,59 +92,126 @@ void PersistentMessageService::StoreMessage(PersistentMessage& message) {
     stmt.ExpectDone();
 
     message.header.messageId = static_cast<uint32_t>(db_->GetLastInsertId());
+
+    if (IsListedStatus(message.header.status)) {
+        UpdateHeaders(message.header.avatarId, [header = message.header](
+                                                   std::vector<PersistentHeader>& headers) {
+            // Replays may reach a load that already read the message.
+            auto found = std::find_if(std::begin(headers), std::end(headers),
+                [&header](const PersistentHeader& h) { return h.messageId == header.messageId; });
+            if (found == std::end(headers)) {
+                headers.push_back(header);
+            }
+        });
+    }
 }
 
-std::vector<PersistentHeader> PersistentMessageService::GetMessageHeaders(uint32_t avatarId) {
-    std::vector<PersistentHeader> headers;
-    
-    char sql[] = "SELECT id, avatar_id, from_name, from_address, subject, sent_time, status, "
-                 "folder, category, message, oob FROM persistent_message WHERE avatar_id = "
-                 "@avatar_id AND status IN (1, 2, 3)";
+std::vector<PersistentHeader> PersistentMessageService::ReadMessageHeaders(
+    IDatabaseConnection& db, uint32_t avatarId) {
+    return ReadMessageHeaderPage(db, avatarId, PersistentHeaderQuery{}).headers;
+}
 
-    StatementHandle stmt{db_->Prepare(sql)};
+PersistentHeaderPage PersistentMessageService::ReadMessageHeaderPage(
+    IDatabaseConnection& db, uint32_t avatarId, const PersistentHeaderQuery& query) {
+    PersistentHeaderPage page;
 
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
+    WaitForPendingWrites(avatarId);
 
-    stmt->BindInt(avatarIdIdx, avatarId);
+    // Served by the (avatar_id, status, id) index added in V002.
+    std::string sql = "SELECT id, avatar_id, from_name, from_address, subject, sent_time, status, "
+                      "folder, category FROM persistent_message WHERE avatar_id = @avatar_id "
+                      "AND status IN (1, 2, 3) AND id > @since_id";
+
+    if (!query.category.empty()) {
+        sql += " AND category = @category";
+    }
+
+    sql += " ORDER BY id";
+
+    if (query.pageSize != 0) {
+        // One extra row tells whether another page follows.
+        sql += " LIMIT @limit";
+    }
+
+    StatementHandle stmt{db.Prepare(sql)};
+
+    stmt->BindInt(stmt->BindParameterIndex("@avatar_id"), avatarId);
+    stmt->BindInt(stmt->BindParameterIndex("@since_id"), query.sinceMessageId);
+
+    if (!query.category.empty()) {
+        stmt->BindText(stmt->BindParameterIndex("@category"), FromWideString(query.category));
+    }
+
+    if (query.pageSize != 0) {
+        stmt->BindInt(stmt->BindParameterIndex("@limit"), static_cast<int64_t>(query.pageSize) + 1);
+    }
+
+    stmt->EnableStreaming();
 
     while (stmt->Step() == StatementStepResult::Row) {
-        PersistentHeader header;
+        if (query.pageSize != 0 && page.headers.size() == query.pageSize) {
+            page.nextSinceMessageId = page.headers.back().messageId;
+            break;
+        }
 
+        PersistentHeader header;
         header.messageId = stmt->ColumnInt(0);
         header.avatarId = stmt->ColumnInt(1);
 
-        auto tmp = stmt->ColumnText(2);
-        header.fromName = std::u16string(std::begin(tmp), std::end(tmp));
+        auto text = stmt->ColumnTextView(2);
+        header.fromName = std::u16string(std::begin(text), std::end(text));
 
-        tmp = stmt->ColumnText(3);
-        header.fromAddress = std::u16string(std::begin(tmp), std::end(tmp));
+        text = stmt->ColumnTextView(3);
+        header.fromAddress = std::u16string(std::begin(text), std::end(text));
 
-        tmp = stmt->ColumnText(4);
-        header.subject = std::u16string(std::begin(tmp), std::end(tmp));
+        text = stmt->ColumnTextView(4);
+        header.subject = std::u16string(std::begin(text), std::end(text));
 
         header.sentTime = stmt->ColumnInt(5);
         header.status = static_cast<PersistentState>(stmt->ColumnInt(6));
 
-        tmp = stmt->ColumnText(7);
-        header.folder = std::u16string(std::begin(tmp), std::end(tmp));
+        text = stmt->ColumnTextView(7);
+        header.folder = std::u16string(std::begin(text), std::end(text));
 
-        tmp = stmt->ColumnText(8);
-        header.category = std::u16string(std::begin(tmp), std::end(tmp));
+        text = stmt->ColumnTextView(8);
+        header.category = std::u16string(std::begin(text), std::end(text));
 
-        headers.push_back(std::move(header));
+        page.headers.push_back(std::move(header));
     }
 
-    return headers;
+    return page;
 }
 
-PersistentMessage PersistentMessageService::GetPersistentMessage(
-    uint32_t avatarId, uint32_t messageId) {
-    
+PersistentHeaderPage PersistentMessageService::SelectHeaderPage(
+    const std::vector<PersistentHeader>& headers, const PersistentHeaderQuery& query) {
+    PersistentHeaderPage page;
+
+    for (const auto& header : headers) {
+        if (header.messageId <= query.sinceMessageId
+            || (!query.category.empty() && header.category != query.category)) {
+            continue;
+        }
+
+        if (query.pageSize != 0 && page.headers.size() == query.pageSize) {
+            page.nextSinceMessageId = page.headers.back().messageId;
+            break;
+        }
+
+        page.headers.push_back(header);
+    }
+
+    return page;
+}
+
+PersistentMessage PersistentMessageService::ReadPersistentMessage(
+    IDatabaseConnection& db, uint32_t avatarId, uint32_t messageId) {
+    WaitForPendingWrites(avatarId);
+
     char sql[] = "SELECT id, avatar_id, from_name, from_address, subject, sent_time, status, "
                  "folder, category, message, oob FROM persistent_message WHERE id = @message_id "
                  "AND avatar_id = @avatar_id";
 
-    StatementHandle stmt{db_->Prepare(sql)};
+    StatementHandle stmt{db.Prepare(sql)};
 
     int messageIdIdx = stmt->BindParameterIndex("@message_id");
     int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
@@ -122,32 +223,32 @@ PersistentMessage PersistentMessageService::GetPersistentMessage(
         throw ChatResultException{ChatResultCode::PMSGNOTFOUND};
     }
 
-    std::string tmp;
+    boost::string_ref text;
 
     PersistentMessage message;
     message.header.messageId = messageId;
     message.header.avatarId = avatarId;
 
-    tmp = stmt->ColumnText(2);
-    message.header.fromName = std::u16string(std::begin(tmp), std::end(tmp));
+    text = stmt->ColumnTextView(2);
+    message.header.fromName = std::u16string(std::begin(text), std::end(text));
 
-    tmp = stmt->ColumnText(3);
-    message.header.fromAddress = std::u16string(std::begin(tmp), std::end(tmp));
+    text = stmt->ColumnTextView(3);
+    message.header.fromAddress = std::u16string(std::begin(text), std::end(text));
 
-    tmp = stmt->ColumnText(4);
-    message.header.subject = std::u16string(std::begin(tmp), std::end(tmp));
+    text = stmt->ColumnTextView(4);
+    message.header.subject = std::u16string(std::begin(text), std::end(text));
 
     message.header.sentTime = stmt->ColumnInt(5);
     message.header.status = static_cast<PersistentState>(stmt->ColumnInt(6));
 
-    tmp = stmt->ColumnText(7);
-    message.header.folder = std::u16string(std::begin(tmp), std::end(tmp));
+    text = stmt->ColumnTextView(7);
+    message.header.folder = std::u16string(std::begin(text), std::end(text));
 
-    tmp = stmt->ColumnText(8);
-    message.header.category = std::u16string(std::begin(tmp), std::end(tmp));
+    text = stmt->ColumnTextView(8);
+    message.header.category = std::u16string(std::begin(text), std::end(text));
 
-    tmp = stmt->ColumnText(9);
-    message.message = std::u16string(std::begin(tmp), std::end(tmp));
+    text = stmt->ColumnTextView(9);
+    message.message = std::u16string(std::begin(text), std::end(text));
 
     int size = stmt->ColumnBytes(10);
     const uint8_t* data = stmt->ColumnBlob(10);
@@ -156,61 +257,138 @@ PersistentMessage PersistentMessageService::GetPersistentMessage(
         throw DatabaseException{"persistent_message.oob blob has invalid UTF-16 byte length"};
     }
 
-    const int codeUnitCount = size / static_cast<int>(sizeof(uint16_t));
-    message.oob.resize(codeUnitCount);
-    for (int i = 0; i < codeUnitCount; ++i) {
-        uint16_t value = 0;
-        value = static_cast<uint16_t>(data[i * 2])
-            | static_cast<uint16_t>(static_cast<uint16_t>(data[i * 2 + 1]) << 8);
-        message.oob[i] = value;
+    // StoreMessage binds the oob code units as raw bytes, so they are copied straight back.
+    message.oob.resize(size / sizeof(uint16_t));
+    if (size > 0) {
+        std::memcpy(&message.oob[0], data, size);
     }
 
-    
+    return message;
+}
+
+void PersistentMessageService::MarkMessageRead(const PersistentMessage& message) {
     if (message.header.status == PersistentState::NEW) {
         UpdateMessageStatus(
             message.header.avatarId, message.header.messageId, PersistentState::READ);
     }
-
-    return message;
 }
 
 void PersistentMessageService::UpdateMessageStatus(
     uint32_t avatarId, uint32_t messageId, PersistentState status) {
-    
-    char sql[] = "UPDATE persistent_message SET status = @status WHERE id = @message_id AND "
-                 "avatar_id = @avatar_id";
+    PersistenceOp op{PersistenceOpKind::Update,
+        "UPDATE persistent_message SET status = @status WHERE id = @message_id AND "
+        "avatar_id = @avatar_id",
+        {}, MessageScope(avatarId) + ":" + std::to_string(messageId), MessageScope(avatarId)};
 
-    StatementHandle stmt{db_->Prepare(sql)};
-
-    int statusIdx = stmt->BindParameterIndex("@status");
-    int messageIdIdx = stmt->BindParameterIndex("@message_id");
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-
-    stmt->BindInt(statusIdx, static_cast<uint32_t>(status));
-    stmt->BindInt(messageIdIdx, messageId);
-    stmt->BindInt(avatarIdIdx, avatarId);
+    op.BindInt("@status", static_cast<uint32_t>(status))
+        .BindInt("@message_id", messageId)
+        .BindInt("@avatar_id", avatarId);
 
-    stmt.ExpectDone();
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 
+    UpdateHeaders(avatarId, [messageId, status](std::vector<PersistentHeader>& headers) {
+        SetHeaderStatus(headers,
+            [messageId](const PersistentHeader& h) { return h.messageId == messageId; }, status);
+    });
 }
 
 void PersistentMessageService::BulkUpdateMessageStatus(
     uint32_t avatarId, const std::u16string& category, PersistentState newStatus)
 {
-    
-    char sql[] = "UPDATE persistent_message SET status = @status WHERE avatar_id = @avatar_id AND "
-             "category = @category";
+    std::string cat = FromWideString(category);
 
-    StatementHandle stmt{db_->Prepare(sql)};
+    PersistenceOp op{PersistenceOpKind::Update,
+        "UPDATE persistent_message SET status = @status WHERE avatar_id = @avatar_id AND "
+        "category = @category",
+        {}, MessageScope(avatarId) + ":category:" + cat, MessageScope(avatarId)};
 
-    int statusIdx = stmt->BindParameterIndex("@status");
-    int avatarIdIdx = stmt->BindParameterIndex("@avatar_id");
-    int categoryIdx = stmt->BindParameterIndex("@category");
+    op.BindInt("@status", static_cast<uint32_t>(newStatus))
+        .BindInt("@avatar_id", avatarId)
+        .BindText("@category", cat);
 
-    stmt->BindInt(statusIdx, static_cast<uint32_t>(newStatus));
-    stmt->BindInt(avatarIdIdx, avatarId);
-    std::string cat = FromWideString(category);
-    stmt->BindText(categoryIdx, cat);
+    PersistOrExecute(*db_, persistenceQueue_, std::move(op));
 
-    stmt.ExpectDone();
+    if (IsListedStatus(newStatus)) {
+        // The update also lists trashed and deleted messages in the category again, which the
+        // cache no longer holds, so the headers are read from the database next time.
+        DropCachedHeaders(avatarId);
+
+        auto pending_iter = pendingHeaderLoads_.find(avatarId);
+        if (pending_iter != std::end(pendingHeaderLoads_)) {
+            pending_iter->second.stale = true;
+        }
+
+        return;
+    }
+
+    UpdateHeaders(avatarId, [category, newStatus](std::vector<PersistentHeader>& headers) {
+        SetHeaderStatus(headers,
+            [&category](const PersistentHeader& h) { return h.category == category; }, newStatus);
+    });
+}
+
+const std::vector<PersistentHeader>* PersistentMessageService::FindCachedHeaders(
+    uint32_t avatarId) const {
+    auto find_iter = headerCache_.find(avatarId);
+    return find_iter != std::end(headerCache_) ? &find_iter->second : nullptr;
+}
+
+void PersistentMessageService::BeginHeaderLoad(uint32_t avatarId) {
+    ++pendingHeaderLoads_[avatarId].inFlight;
+}
+
+std::vector<PersistentHeader> PersistentMessageService::AdoptLoadedHeaders(
+    uint32_t avatarId, std::future<std::vector<PersistentHeader>> loaded, bool cache) {
+    std::vector<HeaderChange> changes;
+    bool stale = false;
+
+    auto pending_iter = pendingHeaderLoads_.find(avatarId);
+    if (pending_iter != std::end(pendingHeaderLoads_)) {
+        // Every recorded change is replayed; they are idempotent, so changes the read already
+        // saw are harmless.
+        changes = pending_iter->second.changes;
+        stale = pending_iter->second.stale;
+        if (--pending_iter->second.inFlight == 0) {
+            pendingHeaderLoads_.erase(pending_iter);
+        }
+    }
+
+    auto headers = loaded.get();
+
+    if (auto cached = FindCachedHeaders(avatarId)) {
+        // Another load finished first; its headers have been kept current since.
+        return *cached;
+    }
+
+    for (auto& change : changes) {
+        change(headers);
+    }
+
+    if (cache && !stale) {
+        headerCache_[avatarId] = headers;
+    }
+
+    return headers;
+}
+
+void PersistentMessageService::DropCachedHeaders(uint32_t avatarId) {
+    headerCache_.erase(avatarId);
+}
+
+void PersistentMessageService::UpdateHeaders(uint32_t avatarId, HeaderChange change) {
+    auto cache_iter = headerCache_.find(avatarId);
+    if (cache_iter != std::end(headerCache_)) {
+        change(cache_iter->second);
+    }
+
+    auto pending_iter = pendingHeaderLoads_.find(avatarId);
+    if (pending_iter != std::end(pendingHeaderLoads_)) {
+        pending_iter->second.changes.push_back(std::move(change));
+    }
+}
+
+void PersistentMessageService::WaitForPendingWrites(uint32_t avatarId) {
+    if (persistenceQueue_) {
+        persistenceQueue_->WaitForScope(MessageScope(avatarId));
+    }
 }
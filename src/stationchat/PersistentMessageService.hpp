@@ -7,20 +7,61 @@
 #include <boost/optional.hpp>
 
 #include <cstdint>
+#include <functional>
+#include <future>
+#include <unordered_map>
 #include <vector>
 
 class IDatabaseConnection;
+class PersistenceQueue;
+
+/** Narrows a header listing; the defaults list every header. */
+struct PersistentHeaderQuery {
+    // Empty matches every category.
+    std::u16string category;
+    // Only headers of messages with a higher id are listed.
+    uint32_t sinceMessageId = 0;
+    // Zero lists every match.
+    uint32_t pageSize = 0;
+
+    bool IsFiltered() const { return !category.empty() || sinceMessageId != 0 || pageSize != 0; }
+};
+
+struct PersistentHeaderPage {
+    std::vector<PersistentHeader> headers;
+    // The sinceMessageId that continues the listing, or zero when nothing is left.
+    uint32_t nextSinceMessageId = 0;
+};
 
 class PersistentMessageService {
 public:
-    explicit PersistentMessageService(IDatabaseConnection* db);
+    /** Status updates go through persistenceQueue when one is given and are executed
+    * synchronously otherwise. Storing a message is always synchronous, since the caller
+    * needs the id the database assigns to it.
+    */
+    explicit PersistentMessageService(
+        IDatabaseConnection* db, PersistenceQueue* persistenceQueue = nullptr);
     ~PersistentMessageService();
 
     void StoreMessage(PersistentMessage& message);
 
-    std::vector<PersistentHeader> GetMessageHeaders(uint32_t avatarId);
+    // The Read* variants only query db and wait on the persistence queue, so they may run on
+    // a database worker; MarkMessageRead completes ReadPersistentMessage on the tick thread.
 
-    PersistentMessage GetPersistentMessage(uint32_t avatarId, uint32_t messageId);
+    std::vector<PersistentHeader> ReadMessageHeaders(IDatabaseConnection& db, uint32_t avatarId);
+
+    /** Headers in message id order, filtered by the database. */
+    PersistentHeaderPage ReadMessageHeaderPage(
+        IDatabaseConnection& db, uint32_t avatarId, const PersistentHeaderQuery& query);
+
+    /** Applies query to headers in message id order, such as the cached ones. */
+    static PersistentHeaderPage SelectHeaderPage(
+        const std::vector<PersistentHeader>& headers, const PersistentHeaderQuery& query);
+
+    PersistentMessage ReadPersistentMessage(
+        IDatabaseConnection& db, uint32_t avatarId, uint32_t messageId);
+
+    void MarkMessageRead(const PersistentMessage& message);
 
     void UpdateMessageStatus(
         uint32_t avatarId, uint32_t messageId, PersistentState status);
@@ -28,6 +69,46 @@ public:
     void BulkUpdateMessageStatus(
         uint32_t avatarId, const std::u16string& category, PersistentState newStatus);
 
+    // Header cache for online avatars. Stored messages and status updates are written through
+    // to it, so a cached mailbox is never read from the database again until it is dropped at
+    // logout. Like the writes, these are used from the tick thread only.
+
+    /** Returns null when the avatar's headers are not cached. */
+    const std::vector<PersistentHeader>* FindCachedHeaders(uint32_t avatarId) const;
+
+    /** Call before ReadMessageHeaders is submitted to a worker. Writes made while the read
+    * is in flight are recorded so that AdoptLoadedHeaders can replay them onto its result.
+    */
+    void BeginHeaderLoad(uint32_t avatarId);
+
+    /** Completes a load started with BeginHeaderLoad and returns its up to date headers,
+    * caching them when cache is set. Rethrows the read's exception, if any.
+    */
+    std::vector<PersistentHeader> AdoptLoadedHeaders(
+        uint32_t avatarId, std::future<std::vector<PersistentHeader>> loaded, bool cache);
+
+    void DropCachedHeaders(uint32_t avatarId);
+
+    size_t GetCachedHeaderAvatarCount() const { return headerCache_.size(); }
+
 private:
+    using HeaderChange = std::function<void(std::vector<PersistentHeader>&)>;
+
+    struct PendingHeaderLoad {
+        int inFlight = 0;
+        std::vector<HeaderChange> changes;
+        // Set by a write that changes cannot replay, so the loads in flight are not cached.
+        bool stale = false;
+    };
+
+    /** Applies change to the cached headers and records it for loads in flight. */
+    void UpdateHeaders(uint32_t avatarId, HeaderChange change);
+
+    /** Reads of an avatar's messages wait for its queued status updates to land first. */
+    void WaitForPendingWrites(uint32_t avatarId);
+
     IDatabaseConnection* db_;
+    PersistenceQueue* persistenceQueue_;
+    std::unordered_map<uint32_t, std::vector<PersistentHeader>> headerCache_;
+    std::unordered_map<uint32_t, PendingHeaderLoad> pendingHeaderLoads_;
 };
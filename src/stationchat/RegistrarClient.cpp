@@ -11,21 +11,19 @@
 #include "easylogging++.h"
 
 RegistrarClient::RegistrarClient(UdpConnection* connection, RegistrarNode* node)
-    : NodeClient(connection)
-    , node_{node} {
-    connection->SetHandler(this);
-}
+    : NodeClient(connection, node->GetNetworkIo())
+    , node_{node} {}
 
 RegistrarClient::~RegistrarClient() {}
 
 RegistrarNode* RegistrarClient::GetNode() { return node_; }
 
-void RegistrarClient::OnIncoming(std::istringstream& istream) {
-    ChatRequestType request_type = ::read<ChatRequestType>(istream);
+void RegistrarClient::OnIncoming(BinaryReader& reader) {
+    ChatRequestType request_type = ::read<ChatRequestType>(reader);
 
     switch (request_type) {
     case ChatRequestType::REGISTRAR_GETCHATSERVER: {
-        auto request = ::read<ReqRegistrarGetChatServer>(istream);
+        auto request = ::read<ReqRegistrarGetChatServer>(reader);
         RegistrarGetChatServer::ResponseType response{request.track};
 
         try {
@@ -16,7 +16,7 @@ public:
     RegistrarNode* GetNode();
 
 private:
-    void OnIncoming(std::istringstream& istream) override;
+    void OnIncoming(BinaryReader& reader) override;
 
     RegistrarNode* node_;
 };
@@ -4,7 +4,8 @@
 #include "StationChatConfig.hpp"
 
 RegistrarNode::RegistrarNode(StationChatConfig& config)
-    : Node(this, config.registrarAddress, config.registrarPort, config.bindToIp)
+    : Node(this, config.registrarAddress, config.registrarPort, config.bindToIp,
+          NetworkIoOptions{config.networkIoThread, config.networkQueueCapacity})
     , config_{config} {}
 
 RegistrarNode::~RegistrarNode() {}
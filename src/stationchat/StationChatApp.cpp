@@ -1,7 +1,11 @@
 #include "StationChatApp.hpp"
 
+#include "DatabaseWorkerPool.hpp"
+
 #include "easylogging++.h"
 
+#include <chrono>
+
 StationChatApp::StationChatApp(StationChatConfig config)
     : config_{std::move(config)} {
     registrarNode_ = std::make_unique<RegistrarNode>(config_);
@@ -9,9 +13,53 @@ StationChatApp::StationChatApp(StationChatConfig config)
 
     gatewayNode_ = std::make_unique<GatewayNode>(config_);
     LOG(INFO) << "Gateway listening @" << config_.gatewayAddress << ":" << config_.gatewayPort;
+
+    NodeLoopOptions options;
+    options.maxBatch = config_.eventLoopMaxBatch;
+    options.housekeepingInterval = std::chrono::milliseconds{config_.eventLoopHousekeepingMs};
+
+    registrarLoop_ = std::make_unique<NodeLoop>(
+        "Registrar", [this]() { registrarNode_->Tick(); }, options);
+    gatewayLoop_ = std::make_unique<NodeLoop>("Gateway", [this]() { gatewayNode_->Tick(); }, options);
+    gatewayLoop_->SetIdleHandler([this]() { gatewayNode_->FlushOutbound(); });
+
+    if (config_.networkIoThread) {
+        // The I/O threads own the sockets and wake the loops once they queued packets.
+        registrarNode_->GetNetworkIo()->SetEventHandler([this]() { registrarLoop_->Wake(); });
+        gatewayNode_->GetNetworkIo()->SetEventHandler([this]() { gatewayLoop_->Wake(); });
+    } else {
+        registrarLoop_->Watch(registrarNode_->GetSocketHandle());
+        gatewayLoop_->Watch(gatewayNode_->GetSocketHandle());
+    }
+
+    gatewayNode_->GetDatabaseWorkers()->SetCompletionHandler([this]() { gatewayLoop_->Wake(); });
+}
+
+StationChatApp::~StationChatApp() {
+    // Nothing may wake a loop that is being destroyed.
+    if (config_.networkIoThread) {
+        registrarNode_->GetNetworkIo()->SetEventHandler(nullptr);
+        gatewayNode_->GetNetworkIo()->SetEventHandler(nullptr);
+    }
+
+    gatewayNode_->GetDatabaseWorkers()->SetCompletionHandler(nullptr);
+}
+
+void StationChatApp::Run() {
+    registrarLoop_->Start();
+    gatewayLoop_->Start();
+
+    while (!stopRequested_) {
+        shutdownLoop_.Wait(std::chrono::milliseconds{1000});
+    }
+
+    LOG(INFO) << "Shutting down";
+
+    registrarLoop_->Stop();
+    gatewayLoop_->Stop();
 }
 
-void StationChatApp::Tick() {
-    registrarNode_->Tick();
-    gatewayNode_->Tick();
+void StationChatApp::Stop() {
+    stopRequested_ = true;
+    shutdownLoop_.Wake();
 }
@@ -1,10 +1,12 @@
-
 #pragma once
 
+#include "EventLoop.hpp"
 #include "GatewayNode.hpp"
+#include "NodeLoop.hpp"
 #include "RegistrarNode.hpp"
 #include "StationChatConfig.hpp"
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -12,14 +14,26 @@
 class StationChatApp {
 public:
     explicit StationChatApp(StationChatConfig config);
+    ~StationChatApp();
+
+    bool IsRunning() const { return !stopRequested_; }
 
-    bool IsRunning() const { return isRunning_; }
+    /** Runs the registrar and the gateway each on its own thread until Stop is called, then
+    * stops both before returning.
+    */
+    void Run();
 
-    void Tick();
+    /** Makes Run return; safe to call from any thread and from a signal handler. */
+    void Stop();
 
 private:
     StationChatConfig config_;
-    bool isRunning_ = true;
+    std::atomic<bool> stopRequested_{false};
     std::unique_ptr<GatewayNode> gatewayNode_;
-    std::unique_ptr<RegistrarNode> registrarNode_;    
+    std::unique_ptr<RegistrarNode> registrarNode_;
+    // Declared after the nodes so that their threads are joined before the nodes go away.
+    std::unique_ptr<NodeLoop> registrarLoop_;
+    std::unique_ptr<NodeLoop> gatewayLoop_;
+    // Only waits for Stop on the thread calling Run.
+    EventLoop shutdownLoop_;
 };
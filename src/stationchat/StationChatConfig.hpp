@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -7,6 +8,8 @@ struct StationChatConfig {
     StationChatConfig() = default;
 
     const uint32_t version = 2;
+    // Offered to clients that ask for it in SETAPIVERSION: version 2 plus batch frames.
+    const uint32_t batchingVersion = 3;
     std::string gatewayAddress;
     uint16_t gatewayPort;
     std::string registrarAddress;
@@ -23,8 +26,18 @@ struct StationChatConfig {
     std::string databaseSslCaPath;
     std::string databaseSslCert;
     std::string databaseSslKey;
+    bool databaseWriteBehind = false;
+    uint32_t databaseWorkerThreads = 2;
+
+    uint32_t eventLoopMaxBatch = 32;
+    uint32_t eventLoopHousekeepingMs = 50;
+    bool networkIoThread = false;
+    size_t networkQueueCapacity = 8192;
+    bool outboundCoalescing = false;
+    uint32_t outboundCoalesceWindowUs = 0;
 
     std::string loggerConfig;
+    size_t avatarCacheCapacity = 50000;
     bool bindToIp = false;
 
     bool policyEnabled = false;
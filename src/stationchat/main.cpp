@@ -6,12 +6,12 @@
 
 #include <boost/program_options.hpp>
 
-#include <chrono>
+#include <atomic>
+#include <csignal>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <string>
-#include <thread>
 #include <vector>
 
 #ifdef __GNUC__
@@ -21,6 +21,13 @@
 INITIALIZE_EASYLOGGINGPP
 
 StationChatConfig BuildConfiguration(int argc, const char* argv[]);
+void ShutdownHandler(int);
+
+namespace {
+// Read by ShutdownHandler, which may only touch lock-free atomics.
+std::atomic<StationChatApp*> runningApp{nullptr};
+static_assert(ATOMIC_POINTER_LOCK_FREE == 2, "the running app must be reachable from a signal handler");
+} // namespace
 
 #ifdef __GNUC__
 void SignalHandler(int sig);
@@ -38,10 +45,15 @@ int main(int argc, const char* argv[]) {
 
     StationChatApp app{config};
 
-    while (app.IsRunning()) {
-        app.Tick();
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
+    runningApp = &app;
+    signal(SIGINT, ShutdownHandler);
+    signal(SIGTERM, ShutdownHandler);
+
+    app.Run();
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    runningApp = nullptr;
 
     return 0;
 }
@@ -107,6 +119,26 @@ StationChatConfig BuildConfiguration(int argc, const char* argv[]) {
             "path to database TLS client certificate (optional)")
         ("database_ssl_key", po::value<std::string>(&config.databaseSslKey)->default_value(""),
             "path to database TLS client key (optional)")
+        ("database_pool_size", po::value<uint32_t>(),
+            "deprecated and ignored; kept so existing configuration files still load. The pool holds one connection per database worker thread (see database_worker_threads)")
+        ("database_worker_threads", po::value<uint32_t>(&config.databaseWorkerThreads)->default_value(2),
+            "number of threads serving slow reads such as persistent message and cold avatar lookups, each on a pooled database connection of its own (minimum 1)")
+        ("database_write_behind", po::value<bool>(&config.databaseWriteBehind)->default_value(false),
+            "queues contact list, room list and message status writes on a second database connection instead of blocking request handling on them; queued writes are held in memory only and are lost if the process exits before they are applied")
+        ("event_loop_max_batch", po::value<uint32_t>(&config.eventLoopMaxBatch)->default_value(32),
+            "maximum number of back to back ticks while traffic keeps arriving before timers get a turn (minimum 1)")
+        ("event_loop_housekeeping_ms", po::value<uint32_t>(&config.eventLoopHousekeepingMs)->default_value(50),
+            "interval in milliseconds at which the nodes are ticked while idle, for udplibrary resends and timeouts (minimum 1)")
+        ("network_io_thread", po::value<bool>(&config.networkIoThread)->default_value(false),
+            "runs each node's udplibrary work on a thread of its own, handing packets to the main loop through lock-free queues")
+        ("network_queue_capacity", po::value<size_t>(&config.networkQueueCapacity)->default_value(8192),
+            "packets each network queue holds before further packets are dropped (rounded up to a power of two)")
+        ("outbound_coalescing", po::value<bool>(&config.outboundCoalescing)->default_value(false),
+            "offers clients that request api version 3 batch frames that carry several messages per packet")
+        ("outbound_coalesce_window_us", po::value<uint32_t>(&config.outboundCoalesceWindowUs)->default_value(0),
+            "microseconds a batching client's messages may be held while the gateway stays busy (0 sends them at the end of each tick)")
+        ("avatar_cache_capacity", po::value<size_t>(&config.avatarCacheCapacity)->default_value(50000),
+            "maximum number of avatars kept in memory; offline avatars not referenced by a room or contact list are evicted first (0 disables eviction)")
         ("policy_enabled", po::value<bool>(&config.policyEnabled)->default_value(false),
             "enables policy evaluation hooks")
         ("policy_shadow_mode", po::value<bool>(&config.policyShadowMode)->default_value(true),
@@ -157,6 +189,13 @@ StationChatConfig BuildConfiguration(int argc, const char* argv[]) {
     return config;
 }
 
+void ShutdownHandler(int) {
+    // Stop only sets a flag and writes to a pipe, both safe in a signal handler.
+    if (auto* app = runningApp.load()) {
+        app->Stop();
+    }
+}
+
 #ifdef __GNUC__
 void SignalHandler(int sig) {
     const int BACKTRACE_LIMIT = 10;
@@ -6,6 +6,7 @@
 class ChatAvatarService;
 class ChatRoomService;
 class GatewayClient;
+class PersistentMessageService;
 
 /** Begin DESTROYAVATAR */
 
@@ -52,4 +53,5 @@ public:
 private:
     ChatAvatarService* avatarService_;
     ChatRoomService* roomService_;
+    PersistentMessageService* messageService_;
 };
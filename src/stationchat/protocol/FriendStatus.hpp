@@ -50,7 +50,8 @@ void write(StreamT& ar, const ResFriendStatus& data) {
 
         write(ar, static_cast<uint32_t>(friends.size()));
         for (auto& friendContact : friends) {
-            write(ar, friendContact);
+            write(ar, FriendContactStatus{
+                friendContact, data.srcAvatar->IsContactOnline(friendContact.avatarId)});
         }
     } else {
         write(ar, static_cast<uint32_t>(0));
@@ -3,6 +3,7 @@
 
 #include "ChatAvatar.hpp"
 #include "ChatEnums.hpp"
+#include "DeferredResponse.hpp"
 
 class ChatAvatarService;
 class GatewayClient;
@@ -61,7 +62,7 @@ public:
     using RequestType = ReqGetAnyAvatar;
     using ResponseType = ResGetAnyAvatar;
 
-    GetAnyAvatar(GatewayClient* client, const RequestType& request, ResponseType& response);
+    GetAnyAvatar(GatewayClient* client, const RequestType& request, DeferredResponse<ResponseType> response);
 
 private:
     ChatAvatarService* avatarService_;
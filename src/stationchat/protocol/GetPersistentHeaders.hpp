@@ -2,11 +2,12 @@
 #pragma once
 
 #include "ChatEnums.hpp"
+#include "DeferredResponse.hpp"
 #include "PersistentMessage.hpp"
+#include "PersistentMessageService.hpp"
 
 #include <vector>
 
-class PersistentMessageService;
 class GatewayClient;
 
 /** Begin GETPERSISTENTHEADERS */
@@ -16,6 +17,10 @@ struct ReqGetPersistentHeaders {
     uint32_t track;
     uint32_t avatarId;
     std::u16string category;
+    // Paging fields appended by newer clients; older requests end after the category.
+    bool paged = false;
+    uint32_t sinceMessageId = 0;
+    uint32_t pageSize = 0;
 };
 
 template <typename StreamT>
@@ -23,6 +28,27 @@ void read(StreamT& ar, ReqGetPersistentHeaders& data) {
     read(ar, data.track);
     read(ar, data.avatarId);
     read(ar, data.category);
+
+    if (ar.remaining() > 0) {
+        data.paged = true;
+        read(ar, data.sinceMessageId);
+        read(ar, data.pageSize);
+    }
+}
+
+/** The listing a request asks for. Older clients send a category that was never applied, so it
+* only narrows requests that carry the paging fields; the rest list every header as before.
+*/
+inline PersistentHeaderQuery ToHeaderQuery(const ReqGetPersistentHeaders& request) {
+    PersistentHeaderQuery query;
+
+    if (request.paged) {
+        query.category = request.category;
+        query.sinceMessageId = request.sinceMessageId;
+        query.pageSize = request.pageSize;
+    }
+
+    return query;
 }
 
 /** Begin GETPERSISTENTHEADERS */
@@ -36,6 +62,9 @@ struct ResGetPersistentHeaders {
     uint32_t track;
     ChatResultCode result;
     std::vector<PersistentHeader> headers;
+    // Only written in reply to a paged request.
+    bool paged = false;
+    uint32_t nextSinceMessageId = 0;
 };
 
 template <typename StreamT>
@@ -48,6 +77,10 @@ void write(StreamT& ar, const ResGetPersistentHeaders& data) {
     for (auto& header : data.headers) {
         write(ar, header);
     }
+
+    if (data.paged) {
+        write(ar, data.nextSinceMessageId);
+    }
 }
 
 class GetPersistentHeaders {
@@ -55,7 +88,7 @@ public:
     using RequestType = ReqGetPersistentHeaders;
     using ResponseType = ResGetPersistentHeaders;
 
-    GetPersistentHeaders(GatewayClient* client, const RequestType& request, ResponseType& response);
+    GetPersistentHeaders(GatewayClient* client, const RequestType& request, DeferredResponse<ResponseType> response);
 
 private:
     PersistentMessageService* messageService_;
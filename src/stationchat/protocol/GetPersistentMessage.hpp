@@ -2,6 +2,7 @@
 #pragma once
 
 #include "ChatEnums.hpp"
+#include "DeferredResponse.hpp"
 #include "PersistentMessage.hpp"
 
 class PersistentMessageService;
@@ -53,7 +54,7 @@ public:
     using RequestType = ReqGetPersistentMessage;
     using ResponseType = ResGetPersistentMessage;
 
-    GetPersistentMessage(GatewayClient* client, const RequestType& request, ResponseType& response);
+    GetPersistentMessage(GatewayClient* client, const RequestType& request, DeferredResponse<ResponseType> response);
 
 private:
     PersistentMessageService* messageService_;
@@ -2,6 +2,7 @@
 
 #include "ChatAvatarService.hpp"
 #include "ChatRoomService.hpp"
+#include "DatabaseWorkerPool.hpp"
 #include "GatewayClient.hpp"
 #include "GatewayNode.hpp"
 #include "PersistentMessageService.hpp"
@@ -245,7 +246,8 @@ CreateRoom::CreateRoom(GatewayClient* client, const RequestType& request, Respon
 DestroyAvatar::DestroyAvatar(
     GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
-    , roomService_{client->GetNode()->GetRoomService()} {
+    , roomService_{client->GetNode()->GetRoomService()}
+    , messageService_{client->GetNode()->GetMessageService()} {
     auto avatar = avatarService_->GetAvatar(request.avatarId);
     if (!avatar) {
         throw ChatResultException{ChatResultCode::SRCAVATARDOESNTEXIST, std::to_string(request.avatarId).c_str()};
@@ -261,6 +263,7 @@ DestroyAvatar::DestroyAvatar(
 
     // Destroy avatar
     avatarService_->DestroyAvatar(avatar);
+    messageService_->DropCachedHeaders(request.avatarId);
 }
 
 DestroyRoom::DestroyRoom(GatewayClient* client, const RequestType& request, ResponseType& response)
@@ -380,38 +383,114 @@ FriendStatus::FriendStatus(
 }
 
 GetAnyAvatar::GetAnyAvatar(
-    GatewayClient* client, const RequestType& request, ResponseType& response)
+    GatewayClient* client, const RequestType& request, DeferredResponse<ResponseType> response)
     : avatarService_{client->GetNode()->GetAvatarService()} {
     LOG(INFO) << "GETANYAVATAR request received - avatar: " << FromWideString(request.name) << "@"
               << FromWideString(request.address);
 
-    auto avatar = avatarService_->GetAvatar(request.name, request.address);
-    if (!avatar) {
-        throw ChatResultException{ChatResultCode::SRCAVATARDOESNTEXIST, (FromWideString(request.name) + " : " +
-                FromWideString(request.address)).c_str()};
+    auto setAvatar = [request](ResponseType& data, const ChatAvatar* avatar) {
+        if (!avatar) {
+            throw ChatResultException{ChatResultCode::SRCAVATARDOESNTEXIST, (FromWideString(request.name) + " : " +
+                    FromWideString(request.address)).c_str()};
+        }
+
+        data.isOnline = avatar->IsOnline();
+        data.avatar = avatar;
+    };
+
+    auto avatar = avatarService_->FindCachedAvatar(request.name, request.address);
+    if (avatar) {
+        response.Complete([&](ResponseType& data) { setAvatar(data, avatar); });
+        return;
     }
 
-    response.isOnline = avatar->IsOnline();
-    response.avatar = avatar;
+    // Cold avatars are hydrated on a database worker and cached once back on the tick thread.
+    auto avatarService = avatarService_;
+    client->GetNode()->GetDatabaseWorkers()->Submit(
+        [avatarService, request](IDatabaseConnection& db) {
+            return avatarService->LoadStoredAvatar(db, request.name, request.address);
+        },
+        [avatarService, response, setAvatar](std::future<std::unique_ptr<ChatAvatar>> result) mutable {
+            response.Complete([&](ResponseType& data) {
+                setAvatar(data, avatarService->AdoptLoadedAvatar(result.get()));
+            });
+        });
 }
 
 GetPersistentHeaders::GetPersistentHeaders(
-    GatewayClient* client, const RequestType& request, ResponseType& response)
+    GatewayClient* client, const RequestType& request, DeferredResponse<ResponseType> response)
     : messageService_{client->GetNode()->GetMessageService()} {
     LOG(INFO) << "GETPERSISTENTHEADERS request recieved - avatar: " << request.avatarId
-              << " category: " << FromWideString(request.category);
+              << " category: " << FromWideString(request.category)
+              << " since: " << request.sinceMessageId << " page size: " << request.pageSize;
+
+    auto query = ToHeaderQuery(request);
+
+    response.Get().paged = request.paged;
+
+    auto fillPage = [](ResponseType& data, PersistentHeaderPage page) {
+        data.headers = std::move(page.headers);
+        data.nextSinceMessageId = page.nextSinceMessageId;
+    };
 
-    response.headers = messageService_->GetMessageHeaders(request.avatarId);
+    if (auto cached = messageService_->FindCachedHeaders(request.avatarId)) {
+        response.Complete([&](ResponseType& data) {
+            fillPage(data, PersistentMessageService::SelectHeaderPage(*cached, query));
+        });
+        return;
+    }
+
+    auto messageService = messageService_;
+    auto avatarId = request.avatarId;
+
+    if (query.IsFiltered()) {
+        // Filtered listings are left to the index rather than loading the whole mailbox.
+        client->GetNode()->GetDatabaseWorkers()->Submit(
+            [messageService, avatarId, query](IDatabaseConnection& db) {
+                return messageService->ReadMessageHeaderPage(db, avatarId, query);
+            },
+            [response, fillPage](std::future<PersistentHeaderPage> result) mutable {
+                response.Complete([&](ResponseType& data) { fillPage(data, result.get()); });
+            });
+        return;
+    }
+
+    auto avatarService = client->GetNode()->GetAvatarService();
+
+    messageService->BeginHeaderLoad(avatarId);
+    client->GetNode()->GetDatabaseWorkers()->Submit(
+        [messageService, avatarId](IDatabaseConnection& db) {
+            return messageService->ReadMessageHeaders(db, avatarId);
+        },
+        [messageService, avatarService, avatarId, response](
+            std::future<std::vector<PersistentHeader>> result) mutable {
+            response.Complete([&](ResponseType& data) {
+                // Only online avatars are cached, as logout is what drops the cache again.
+                bool online = avatarService->GetOnlineAvatar(avatarId) != nullptr;
+                data.headers = messageService->AdoptLoadedHeaders(avatarId, std::move(result), online);
+            });
+        });
 }
 
 GetPersistentMessage::GetPersistentMessage(
-    GatewayClient* client, const RequestType& request, ResponseType& response)
+    GatewayClient* client, const RequestType& request, DeferredResponse<ResponseType> response)
     : messageService_{client->GetNode()->GetMessageService()} {
     LOG(INFO) << "GETPERSISTENTMESSAGE request received - avatar: " << request.srcAvatarId
               << " message: " << request.messageId;
 
-    response.message
-        = messageService_->GetPersistentMessage(request.srcAvatarId, request.messageId);
+    auto messageService = messageService_;
+    auto avatarId = request.srcAvatarId;
+    auto messageId = request.messageId;
+    client->GetNode()->GetDatabaseWorkers()->Submit(
+        [messageService, avatarId, messageId](IDatabaseConnection& db) {
+            return messageService->ReadPersistentMessage(db, avatarId, messageId);
+        },
+        [messageService, response](std::future<PersistentMessage> result) mutable {
+            response.Complete([&](ResponseType& data) {
+                data.message = result.get();
+                messageService->MarkMessageRead(data.message);
+            });
+        });
 }
 
 GetRoom::GetRoom(GatewayClient* client, const RequestType& request, ResponseType& response)
@@ -543,7 +622,8 @@ LoginAvatar::LoginAvatar(GatewayClient* client, const RequestType& request, Resp
 
 LogoutAvatar::LogoutAvatar(GatewayClient* client, const RequestType& request, ResponseType& response)
     : avatarService_{client->GetNode()->GetAvatarService()}
-    , roomService_{client->GetNode()->GetRoomService()} {
+    , roomService_{client->GetNode()->GetRoomService()}
+    , messageService_{client->GetNode()->GetMessageService()} {
     LOG(INFO) << "LOGOUTAVATAR request received - avatar id:" << request.avatarId;
 
     auto avatar = avatarService_->GetAvatar(request.avatarId);
@@ -558,6 +638,7 @@ LogoutAvatar::LogoutAvatar(GatewayClient* client, const RequestType& request, Re
     client->SendFriendLogoutUpdates(avatar);
 
     avatarService_->LogoutAvatar(avatar);
+    messageService_->DropCachedHeaders(request.avatarId);
 }
 
 RegistrarGetChatServer::RegistrarGetChatServer(RegistrarClient* client, const RequestType& request, ResponseType& response) {
@@ -805,7 +886,14 @@ SendRoomMessage::SendRoomMessage(
 SetApiVersion::SetApiVersion(
     GatewayClient* client, const RequestType& request, ResponseType& response) {
     LOG(INFO) << "SETAPIVERSION request received - version: " << request.version;
-    response.version = client->GetNode()->GetConfig().version;
+    const auto& config = client->GetNode()->GetConfig();
+    response.version = config.version;
+
+    if (config.outboundCoalescing && request.version == config.batchingVersion) {
+        response.version = config.batchingVersion;
+        client->EnableBatching();
+    }
+
     response.result = (response.version == request.version)
         ? ChatResultCode::SUCCESS
         : ChatResultCode::WRONGCHATSERVERFORREQUEST;
@@ -1,2 +1,6 @@
 #define CATCH_CONFIG_MAIN
-#include "catch.hpp"
\ No newline at end of file
+#include "catch.hpp"
+
+#include <easylogging++.h>
+
+INITIALIZE_EASYLOGGINGPP
@@ -0,0 +1,83 @@
+#include "catch.hpp"
+
+#include "BinaryReader.hpp"
+#include "BinaryWriter.hpp"
+#include "Serialization.hpp"
+
+#include <string>
+
+namespace {
+
+BinaryReader MakeReader(const BinaryWriter& writer, size_t length) {
+    return BinaryReader{reinterpret_cast<const unsigned char*>(writer.data()),
+        static_cast<int>(length)};
+}
+
+} // namespace
+
+SCENARIO("binary reader decodes what the writer encodes", "[serialization]") {
+    GIVEN("a packet holding an integer, an ascii string and a utf16 string") {
+        BinaryWriter writer;
+        write(writer, static_cast<uint32_t>(42));
+        write(writer, std::string{"ascii value"});
+        write(writer, std::u16string{u"wide value"});
+
+        WHEN("the whole packet is read") {
+            auto reader = MakeReader(writer, writer.size());
+            auto number = read<uint32_t>(reader);
+            auto ascii = read<std::string>(reader);
+            auto wide = read<std::u16string>(reader);
+
+            THEN("every field round trips and the packet is consumed") {
+                REQUIRE(number == 42);
+                REQUIRE(ascii == "ascii value");
+                REQUIRE(wide == u"wide value");
+                REQUIRE(reader.remaining() == 0);
+            }
+        }
+
+        WHEN("a field is peeked at by offset") {
+            auto reader = MakeReader(writer, writer.size());
+            read<uint32_t>(reader);
+
+            THEN("the read position is preserved") {
+                REQUIRE(peekAt<uint32_t>(reader, 0) == 42);
+                REQUIRE(reader.tellg() == sizeof(uint32_t));
+            }
+        }
+    }
+
+    GIVEN("a truncated packet") {
+        BinaryWriter writer;
+        write(writer, std::u16string{u"wide value"});
+
+        THEN("reading past the end throws instead of leaving the field unset") {
+            auto reader = MakeReader(writer, writer.size() - 1);
+            std::u16string value;
+            REQUIRE_THROWS_AS(read(reader, value), SerializationException);
+        }
+
+        THEN("an integer cut short throws") {
+            auto reader = MakeReader(writer, 2);
+            REQUIRE_THROWS_AS(read<uint32_t>(reader), SerializationException);
+        }
+
+        THEN("seeking past the end throws") {
+            auto reader = MakeReader(writer, writer.size());
+            REQUIRE_THROWS_AS(reader.seekg(writer.size() + 1), SerializationException);
+        }
+    }
+
+    GIVEN("a length prefix far larger than the packet") {
+        BinaryWriter writer;
+        write(writer, static_cast<uint32_t>(0x7FFFFFFF));
+        write(writer, static_cast<uint16_t>(0x41));
+
+        THEN("the string is rejected before any storage is allocated for it") {
+            auto reader = MakeReader(writer, writer.size());
+            std::u16string value;
+            REQUIRE_THROWS_AS(read(reader, value), SerializationException);
+            REQUIRE(value.empty());
+        }
+    }
+}
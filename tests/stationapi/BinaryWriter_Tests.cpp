@@ -0,0 +1,112 @@
+#include "catch.hpp"
+
+#include "BinaryWriter.hpp"
+#include "Serialization.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+struct SampleMessage {
+    uint16_t type = 7;
+    uint32_t track = 12;
+    bool flag = true;
+    std::string name = "ascii value";
+    std::u16string message = u"a typical chat message body";
+    std::u16string oob = u"out of band";
+};
+
+} // namespace
+
+template <typename StreamT>
+void write(StreamT& ar, const SampleMessage& data) {
+    write(ar, data.type);
+    write(ar, data.track);
+    write(ar, data.flag);
+    write(ar, data.name);
+    write(ar, data.message);
+    write(ar, data.oob);
+}
+
+SCENARIO("binary writer output matches the stream serialization", "[serialization]") {
+    GIVEN("a message serialized through a binary stream") {
+        SampleMessage message;
+        std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+        write(stream, message);
+        auto expected = stream.str();
+
+        WHEN("the same message is written to a binary writer") {
+            BinaryWriter writer;
+            write(writer, message);
+
+            THEN("the bytes are identical") {
+                REQUIRE(std::string(writer.data(), writer.size()) == expected);
+            }
+
+            AND_WHEN("the writer is cleared and reused") {
+                auto capacity = writer.capacity();
+                writer.clear();
+                write(writer, message);
+
+                THEN("the output is the same and no further capacity was needed") {
+                    REQUIRE(std::string(writer.data(), writer.size()) == expected);
+                    REQUIRE(writer.capacity() == capacity);
+                }
+            }
+        }
+    }
+
+    GIVEN("a utf16 string") {
+        std::u16string value = u"été";
+        BinaryWriter writer;
+
+        WHEN("it is written") {
+            write(writer, value);
+
+            THEN("the length prefix is followed by little-endian code units") {
+                REQUIRE(writer.size() == sizeof(uint32_t) + value.length() * sizeof(uint16_t));
+                REQUIRE(static_cast<uint8_t>(writer.data()[4]) == 0xE9);
+                REQUIRE(static_cast<uint8_t>(writer.data()[5]) == 0x00);
+                REQUIRE(static_cast<uint8_t>(writer.data()[6]) == 't');
+            }
+        }
+    }
+}
+
+SCENARIO("binary writer serialization cost compared to a string stream", "[.][benchmark][serialization]") {
+    const uint32_t iterations = 1000000;
+    SampleMessage message;
+
+    size_t streamBytes = 0;
+    std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        stream.clear();
+        stream.str("");
+        write(stream, message);
+        auto data = stream.str();
+        streamBytes += data.length();
+    }
+    auto streamElapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    size_t writerBytes = 0;
+    BinaryWriter writer{512};
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i) {
+        writer.clear();
+        write(writer, message);
+        writerBytes += writer.size();
+    }
+    auto writerElapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    REQUIRE(streamBytes == writerBytes);
+
+    std::cout << "ostringstream: " << streamElapsed.count() / iterations << " ns/message, "
+              << "BinaryWriter: " << writerElapsed.count() / iterations << " ns/message"
+              << std::endl;
+}
@@ -0,0 +1,172 @@
+#include "catch.hpp"
+
+#include "EventLoop.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+/** A pipe standing in for a node's UDP socket. */
+class Pipe {
+public:
+    Pipe() {
+        int descriptors[2];
+        REQUIRE(pipe(descriptors) == 0);
+        readEnd = descriptors[0];
+        writeEnd = descriptors[1];
+        fcntl(readEnd, F_SETFL, fcntl(readEnd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    ~Pipe() {
+        close(readEnd);
+        close(writeEnd);
+    }
+
+    // Also called from sender threads, so it does not use Catch assertions.
+    void Send() {
+        const char byte = 1;
+        auto written = write(writeEnd, &byte, 1);
+        (void)written;
+    }
+
+    bool Drain() {
+        char buffer[64];
+        bool drained = false;
+        while (read(readEnd, buffer, sizeof(buffer)) > 0) {
+            drained = true;
+        }
+        return drained;
+    }
+
+    int readEnd;
+    int writeEnd;
+};
+
+} // namespace
+
+SCENARIO("event loop wakes on traffic, on request and for timers", "[eventloop]") {
+    EventLoop loop;
+    Pipe socket;
+    loop.Watch(socket.readEnd);
+
+    WHEN("nothing happens") {
+        auto start = std::chrono::steady_clock::now();
+        bool ready = loop.Wait(std::chrono::milliseconds{20});
+
+        THEN("the wait times out") {
+            REQUIRE_FALSE(ready);
+            REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds{15});
+        }
+    }
+
+    WHEN("a watched descriptor becomes readable") {
+        socket.Send();
+
+        THEN("the wait returns straight away") {
+            REQUIRE(loop.Wait(std::chrono::seconds{5}));
+        }
+    }
+
+    WHEN("another thread wakes the loop") {
+        std::thread waker{[&loop]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            loop.Wake();
+            loop.Wake();
+        }};
+
+        bool ready = loop.Wait(std::chrono::seconds{5});
+        waker.join();
+
+        THEN("the wait returns and the repeated wake is absorbed") {
+            REQUIRE(ready);
+            REQUIRE_FALSE(loop.Wait(std::chrono::milliseconds{0}));
+        }
+    }
+
+    WHEN("a timer is due before anything else happens") {
+        int fired = 0;
+        loop.AddTimer(std::chrono::milliseconds{10}, [&fired]() { ++fired; });
+
+        bool ready = loop.Wait(std::chrono::seconds{5});
+
+        THEN("the wait ends early to run it") {
+            REQUIRE_FALSE(ready);
+            REQUIRE(fired == 1);
+        }
+    }
+
+    WHEN("a negative descriptor is watched") {
+        loop.Watch(-1);
+
+        THEN("it is ignored") {
+            REQUIRE_FALSE(loop.Wait(std::chrono::milliseconds{0}));
+        }
+    }
+}
+
+SCENARIO("event loop request latency compared with the fixed sleep loop", "[.][benchmark][eventloop]") {
+    const int requests = 500;
+
+    // Sends requests at uneven intervals and measures how long each waits to be noticed.
+    auto measure = [requests](auto waitForTraffic) {
+        Pipe socket;
+        std::atomic<std::chrono::steady_clock::rep> sentAt{0};
+        std::vector<std::chrono::microseconds> latencies;
+
+        std::thread sender{[&]() {
+            for (int i = 0; i < requests; ++i) {
+                std::this_thread::sleep_for(std::chrono::microseconds{300 + (i * 37) % 900});
+                sentAt = std::chrono::steady_clock::now().time_since_epoch().count();
+                socket.Send();
+
+                while (sentAt != 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }};
+
+        while (static_cast<int>(latencies.size()) < requests) {
+            waitForTraffic(socket);
+
+            if (socket.Drain()) {
+                auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+                latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::duration{now - sentAt}));
+                sentAt = 0;
+            }
+        }
+
+        sender.join();
+
+        std::sort(std::begin(latencies), std::end(latencies));
+        return std::make_pair(latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]);
+    };
+
+    auto sleepLoop = measure([](Pipe&) { std::this_thread::sleep_for(std::chrono::milliseconds{1}); });
+
+    EventLoop loop;
+    bool watching = false;
+    auto eventLoop = measure([&loop, &watching](Pipe& socket) {
+        if (!watching) {
+            loop.Watch(socket.readEnd);
+            watching = true;
+        }
+
+        loop.Wait(std::chrono::seconds{1});
+    });
+
+    std::cout << "request latency over " << requests << " requests: 1ms sleep loop p50 "
+              << sleepLoop.first.count() << " us, p99 " << sleepLoop.second.count()
+              << " us; event loop p50 " << eventLoop.first.count() << " us, p99 "
+              << eventLoop.second.count() << " us" << std::endl;
+
+    REQUIRE(eventLoop.first < sleepLoop.first);
+}
@@ -0,0 +1,221 @@
+#include "catch.hpp"
+
+#include "NetworkIo.hpp"
+#include "SpscRing.hpp"
+
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace {
+
+struct ManagerDeleter {
+    void operator()(UdpManager* manager) const { manager->Release(); }
+};
+
+std::unique_ptr<UdpManager, ManagerDeleter> MakeManager() {
+    UdpManager::Params params;
+    return std::unique_ptr<UdpManager, ManagerDeleter>{new UdpManager(&params)};
+}
+
+std::string ToString(const NetworkEvent& event) {
+    return std::string(event.data.begin(), event.data.end());
+}
+
+} // namespace
+
+SCENARIO("spsc ring hands values between two threads in order", "[networkio]") {
+    GIVEN("a ring asked for a capacity that is not a power of two") {
+        SpscRing<int> ring{3};
+
+        THEN("the capacity is rounded up") { REQUIRE(ring.Capacity() == 4); }
+
+        WHEN("it is filled") {
+            for (int i = 0; i < 4; ++i) {
+                REQUIRE(ring.TryPush(int{i}));
+            }
+
+            THEN("further pushes fail and values come out in order") {
+                REQUIRE_FALSE(ring.TryPush(4));
+                REQUIRE(ring.Size() == 4);
+
+                int value = -1;
+                for (int i = 0; i < 4; ++i) {
+                    REQUIRE(ring.TryPop(value));
+                    REQUIRE(value == i);
+                }
+
+                REQUIRE_FALSE(ring.TryPop(value));
+            }
+        }
+    }
+
+    GIVEN("a producer on another thread") {
+        SpscRing<int> ring{16};
+        const int count = 100000;
+
+        std::thread producer{[&ring, count]() {
+            for (int i = 0; i < count; ++i) {
+                while (!ring.TryPush(int{i})) {
+                    std::this_thread::yield();
+                }
+            }
+        }};
+
+        int expected = 0;
+        bool ordered = true;
+        int value = 0;
+        while (expected < count) {
+            if (ring.TryPop(value)) {
+                ordered = ordered && value == expected;
+                ++expected;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        producer.join();
+
+        THEN("every value arrives once and in order") {
+            REQUIRE(ordered);
+            REQUIRE(ring.Size() == 0);
+        }
+    }
+}
+
+SCENARIO("network io routes connection traffic through its queues", "[networkio]") {
+    auto manager = MakeManager();
+    NetworkIo io{manager.get(), -1, 2};
+    UdpConnection connection;
+
+    int notified = 0;
+    io.SetEventHandler([&notified]() { ++notified; });
+
+    GIVEN("an accepted connection") {
+        io.Accept(&connection);
+
+        NetworkEvent event;
+        REQUIRE(io.PopEvent(event));
+        REQUIRE(event.type == NetworkEvent::Type::Connected);
+        REQUIRE(event.connection == &connection);
+        REQUIRE(connection.handler == &io);
+
+        WHEN("packets arrive") {
+            const uchar data[] = {'h', 'i'};
+            connection.handler->OnRoutePacket(&connection, data, 2);
+            io.Service();
+
+            THEN("they are queued for the node and the node is notified") {
+                REQUIRE(io.PopEvent(event));
+                REQUIRE(event.type == NetworkEvent::Type::Packet);
+                REQUIRE(ToString(event) == "hi");
+                REQUIRE(notified == 1);
+            }
+        }
+
+        WHEN("more packets arrive than the queue holds") {
+            const uchar data[] = {'x'};
+            for (int i = 0; i < 3; ++i) {
+                connection.handler->OnRoutePacket(&connection, data, 1);
+            }
+
+            THEN("the excess is dropped and counted") {
+                auto stats = io.GetStats();
+                REQUIRE(stats.inboundDepth == 2);
+                REQUIRE(stats.inboundDropped == 1);
+            }
+        }
+
+        WHEN("the node sends") {
+            io.Send(&connection, "reply", 5);
+            REQUIRE(connection.sent.empty());
+
+            io.Service();
+
+            THEN("the packet goes out on the next pass of the I/O thread") {
+                REQUIRE(connection.sent.size() == 1);
+                REQUIRE(connection.sent[0] == "reply");
+            }
+        }
+
+        WHEN("the connection drops") {
+            connection.status = UdpConnection::cStatusDisconnected;
+            io.Service();
+            io.Service();
+
+            THEN("the node is told once") {
+                REQUIRE(io.PopEvent(event));
+                REQUIRE(event.type == NetworkEvent::Type::Disconnected);
+                REQUIRE_FALSE(io.PopEvent(event));
+            }
+        }
+
+        WHEN("the node closes the connection") {
+            io.Close(&connection);
+            io.Service();
+
+            THEN("it is detached from the I/O thread") { REQUIRE(connection.handler == nullptr); }
+        }
+
+        WHEN("the connection drops while the inbound queue is full") {
+            const uchar data[] = {'x'};
+            for (int i = 0; i < 3; ++i) {
+                connection.handler->OnRoutePacket(&connection, data, 1);
+            }
+
+            connection.status = UdpConnection::cStatusDisconnected;
+            io.Service();
+
+            THEN("the disconnect is still delivered, after the packets queued before it") {
+                REQUIRE(io.PopEvent(event));
+                REQUIRE(event.type == NetworkEvent::Type::Packet);
+                REQUIRE(io.PopEvent(event));
+                REQUIRE(event.type == NetworkEvent::Type::Packet);
+                REQUIRE(io.PopEvent(event));
+                REQUIRE(event.type == NetworkEvent::Type::Disconnected);
+                REQUIRE_FALSE(io.PopEvent(event));
+            }
+        }
+
+        WHEN("the node closes the connection while the outbound queue is full") {
+            for (int i = 0; i < 3; ++i) {
+                io.Send(&connection, "reply", 5);
+            }
+
+            io.Close(&connection);
+            io.Service();
+
+            THEN("the close does not wait for room and follows the packets queued before it") {
+                REQUIRE(connection.sent.size() == 2);
+                REQUIRE(connection.handler == nullptr);
+                REQUIRE(connection.GetStatus() == UdpConnection::cStatusDisconnected);
+                REQUIRE(io.GetStats().outboundDropped == 1);
+            }
+        }
+    }
+
+    GIVEN("a packet that arrives right after its connection is accepted") {
+        io.Accept(&connection);
+        const uchar data[] = {'h', 'i'};
+        connection.handler->OnRoutePacket(&connection, data, 2);
+
+        THEN("the node sees the connection before the packet") {
+            NetworkEvent event;
+            REQUIRE(io.PopEvent(event));
+            REQUIRE(event.type == NetworkEvent::Type::Connected);
+            REQUIRE(io.PopEvent(event));
+            REQUIRE(event.type == NetworkEvent::Type::Packet);
+        }
+    }
+
+    GIVEN("a running I/O thread") {
+        io.Start();
+        io.Send(&connection, "queued", 6);
+        io.Stop();
+
+        THEN("what was queued is sent before it stops") {
+            REQUIRE(connection.sent.size() == 1);
+            REQUIRE(connection.sent[0] == "queued");
+        }
+    }
+}
@@ -0,0 +1,203 @@
+#include "catch.hpp"
+
+#include "BinaryReader.hpp"
+#include "NodeClient.hpp"
+#include "Serialization.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+class TestClient : public NodeClient {
+public:
+    explicit TestClient(UdpConnection* connection)
+        : NodeClient(connection) {}
+
+private:
+    void OnIncoming(BinaryReader&) override {}
+};
+
+/** Counts how often it is serialized. */
+struct CountedMessage {
+    uint32_t value;
+    int* serializations;
+};
+
+template <typename StreamT>
+void write(StreamT& ostream, const CountedMessage& message) {
+    ++*message.serializations;
+    ::write(ostream, message.value);
+}
+
+/** Splits a batch frame back into its messages, as a peer on api version 3 would. */
+std::vector<std::string> ReadBatchFrame(const std::string& packet) {
+    BinaryReader reader{
+        reinterpret_cast<const unsigned char*>(packet.data()), static_cast<int>(packet.size())};
+
+    auto marker = ::read<uint16_t>(reader);
+    REQUIRE(marker == NodeClient::kBatchFrameMarker);
+
+    std::vector<std::string> messages;
+    auto count = ::read<uint16_t>(reader);
+    for (uint16_t i = 0; i < count; ++i) {
+        auto length = ::read<uint32_t>(reader);
+        std::string message(length, '\0');
+        reader.read(&message[0], length);
+        messages.push_back(message);
+    }
+
+    REQUIRE(reader.remaining() == 0);
+    return messages;
+}
+
+} // namespace
+
+SCENARIO("node clients gather messages into batch frames once negotiated", "[nodeclient]") {
+    UdpConnection connection;
+    OutboundStats stats;
+
+    TestClient client{&connection};
+    client.SetOutboundStats(&stats);
+
+    GIVEN("a client that did not negotiate batching") {
+        client.Send("one", 3);
+        client.Send("two", 3);
+
+        THEN("each message goes out in a packet of its own") {
+            REQUIRE(connection.sent.size() == 2);
+            REQUIRE(connection.sent[0] == "one");
+            REQUIRE(stats.packets == 2);
+            REQUIRE(stats.messages == 2);
+            REQUIRE(stats.batchFrames == 0);
+        }
+    }
+
+    GIVEN("a batching client") {
+        client.EnableBatching();
+
+        WHEN("several messages are sent in one tick") {
+            client.Send("one", 3);
+            client.Send("two", 3);
+            client.Send("three", 5);
+            REQUIRE(connection.sent.empty());
+
+            client.FlushBatch();
+
+            THEN("they go out together in one frame") {
+                REQUIRE(connection.sent.size() == 1);
+                REQUIRE(ReadBatchFrame(connection.sent[0]) == (std::vector<std::string>{"one", "two", "three"}));
+                REQUIRE(stats.packets == 1);
+                REQUIRE(stats.messages == 3);
+                REQUIRE(stats.batchFrames == 1);
+            }
+        }
+
+        WHEN("a single message is flushed") {
+            client.Send("alone", 5);
+            client.FlushBatch();
+
+            THEN("it is sent without a frame") {
+                REQUIRE(connection.sent.size() == 1);
+                REQUIRE(connection.sent[0] == "alone");
+            }
+        }
+
+        WHEN("a message too large for a batch follows smaller ones") {
+            std::string large(NodeClient::kMaxBatchBytes, 'x');
+            client.Send("one", 3);
+            client.Send("two", 3);
+            client.Send(large.data(), static_cast<uint32_t>(large.size()));
+
+            THEN("the batch is sent first and the large message after it on its own") {
+                REQUIRE(connection.sent.size() == 2);
+                REQUIRE(ReadBatchFrame(connection.sent[0]) == (std::vector<std::string>{"one", "two"}));
+                REQUIRE(connection.sent[1] == large);
+            }
+        }
+
+        WHEN("messages fill a batch") {
+            std::string message(100, 'm');
+            for (int i = 0; i < 20; ++i) {
+                client.Send(message.data(), static_cast<uint32_t>(message.size()));
+            }
+
+            client.FlushBatch();
+
+            THEN("no packet grows past the batch limit") {
+                size_t delivered = 0;
+                for (const auto& packet : connection.sent) {
+                    REQUIRE(packet.size() <= NodeClient::kMaxBatchBytes);
+                    delivered += ReadBatchFrame(packet).size();
+                }
+
+                REQUIRE(connection.sent.size() > 1);
+                REQUIRE(delivered == 20);
+            }
+        }
+
+        WHEN("the client is destroyed with messages still gathered") {
+            UdpConnection closing;
+            {
+                TestClient doomed{&closing};
+                doomed.EnableBatching();
+                doomed.Send("one", 3);
+                doomed.Send("two", 3);
+            }
+
+            THEN("they are sent before the connection is closed") {
+                REQUIRE(closing.sent.size() == 1);
+                REQUIRE(ReadBatchFrame(closing.sent[0]) == (std::vector<std::string>{"one", "two"}));
+                REQUIRE(closing.GetStatus() == UdpConnection::cStatusDisconnected);
+            }
+        }
+
+        WHEN("a message waits in the batch") {
+            auto now = std::chrono::steady_clock::now();
+            REQUIRE_FALSE(client.HasBatchOlderThan(std::chrono::microseconds{0}, now));
+
+            client.Send("one", 3);
+
+            THEN("its age is measured from when it was gathered") {
+                auto later = std::chrono::steady_clock::now() + std::chrono::milliseconds{1};
+                REQUIRE(client.HasBatchOlderThan(std::chrono::microseconds{500}, later));
+                REQUIRE_FALSE(client.HasBatchOlderThan(std::chrono::seconds{60}, later));
+            }
+        }
+    }
+}
+
+SCENARIO("a message fanned out to several clients is serialized once", "[nodeclient]") {
+    UdpConnection corellia;
+    UdpConnection naboo;
+    UdpConnection tatooine;
+
+    TestClient corelliaClient{&corellia};
+    TestClient nabooClient{&naboo};
+    TestClient tatooineClient{&tatooine};
+
+    std::map<std::u16string, TestClient*> clients{
+        {u"SWG+corellia", &corelliaClient}, {u"SWG+naboo", &nabooClient}, {u"SWG+tatooine", &tatooineClient}};
+
+    GIVEN("addresses of some connected gateways and one that is gone") {
+        std::vector<std::u16string> addresses{u"SWG+corellia", u"SWG+naboo", u"SWG+gone"};
+
+        WHEN("a message is sent to them") {
+            int serializations = 0;
+            BinaryWriter writer;
+            SendToEach(writer, clients, addresses, CountedMessage{0x01020304, &serializations});
+
+            THEN("it is encoded once and each listed client receives the same bytes") {
+                REQUIRE(serializations == 1);
+                REQUIRE(corellia.sent.size() == 1);
+                REQUIRE(naboo.sent.size() == 1);
+                REQUIRE(corellia.sent[0] == naboo.sent[0]);
+                REQUIRE(corellia.sent[0] == std::string(writer.data(), writer.size()));
+                REQUIRE(tatooine.sent.empty());
+            }
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#include "catch.hpp"
+
+#include "NodeLoop.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+/** Waits for a condition set by a loop thread, giving up after a generous timeout. */
+template <typename Predicate>
+bool WaitFor(Predicate predicate) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+
+    return true;
+}
+
+NodeLoopOptions SlowHousekeeping() {
+    NodeLoopOptions options;
+    options.housekeepingInterval = std::chrono::seconds{60};
+    return options;
+}
+
+} // namespace
+
+SCENARIO("node loop ticks its node on a thread of its own", "[nodeloop]") {
+    auto testThread = std::this_thread::get_id();
+
+    GIVEN("a started loop") {
+        std::atomic<int> ticks{0};
+        std::atomic<bool> onOtherThread{true};
+
+        NodeLoop loop{"Test",
+            [&]() {
+                onOtherThread = onOtherThread && std::this_thread::get_id() != testThread;
+                ++ticks;
+            },
+            SlowHousekeeping()};
+        loop.Start();
+
+        WHEN("it is woken") {
+            loop.Wake();
+
+            THEN("the node is ticked on the loop thread") {
+                REQUIRE(WaitFor([&]() { return ticks > 0; }));
+                REQUIRE(onOtherThread);
+            }
+        }
+
+        WHEN("it is stopped") {
+            loop.Stop();
+            auto ticksAtStop = ticks.load();
+            loop.Wake();
+            std::this_thread::sleep_for(std::chrono::milliseconds{20});
+
+            THEN("the thread is joined and the node is not ticked again") {
+                REQUIRE_FALSE(loop.IsRunning());
+                REQUIRE(ticks == ticksAtStop);
+            }
+        }
+    }
+
+    GIVEN("a loop that is never woken") {
+        std::atomic<int> ticks{0};
+
+        NodeLoopOptions options;
+        options.housekeepingInterval = std::chrono::milliseconds{5};
+
+        NodeLoop loop{"Test", [&ticks]() { ++ticks; }, options};
+        loop.Start();
+
+        THEN("the node is still ticked for housekeeping") {
+            REQUIRE(WaitFor([&ticks]() { return ticks >= 3; }));
+        }
+    }
+}
+
+SCENARIO("a busy node loop does not hold up another", "[nodeloop]") {
+    std::atomic<bool> release{false};
+    std::atomic<bool> busy{false};
+    std::atomic<int> registrarTicks{0};
+
+    NodeLoop gateway{"Gateway",
+        [&]() {
+            busy = true;
+            while (!release) {
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            }
+        },
+        SlowHousekeeping()};
+    NodeLoop registrar{"Registrar", [&registrarTicks]() { ++registrarTicks; }, SlowHousekeeping()};
+
+    gateway.Start();
+    registrar.Start();
+
+    gateway.Wake();
+    REQUIRE(WaitFor([&busy]() { return busy.load(); }));
+
+    registrar.Wake();
+    bool registrarTicked = WaitFor([&registrarTicks]() { return registrarTicks > 0; });
+
+    release = true;
+    gateway.Stop();
+    registrar.Stop();
+
+    REQUIRE(registrarTicked);
+}
@@ -0,0 +1,58 @@
+#include "catch.hpp"
+
+#include "AvatarIdSet.hpp"
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "FakeDatabaseConnection.hpp"
+
+SCENARIO("avatar id sets keep insertion order and answer membership by id", "[stationchat][room]") {
+    FakeDatabaseConnection db;
+    ChatAvatarService service{&db};
+
+    auto* third = service.CreateAvatar(u"third", u"corellia", 3, 0, u"coronet");
+    auto* first = service.CreateAvatar(u"first", u"corellia", 1, 0, u"coronet");
+    auto* second = service.CreateAvatar(u"second", u"corellia", 2, 0, u"coronet");
+
+    AvatarIdSet<ChatAvatar*> members;
+
+    GIVEN("avatars inserted out of id order with a duplicate") {
+        REQUIRE(members.Insert(second));
+        REQUIRE(members.Insert(third));
+        REQUIRE(members.Insert(first));
+        REQUIRE_FALSE(members.Insert(third));
+
+        THEN("each avatar is held once, in insertion order, with one reference") {
+            REQUIRE(members.size() == 3);
+            REQUIRE(members[0] == second);
+            REQUIRE(members[1] == third);
+            REQUIRE(members[2] == first);
+            REQUIRE(third->IsReferenced());
+            REQUIRE(members.Contains(first->GetAvatarId()));
+            REQUIRE_FALSE(members.Contains(first->GetAvatarId() + 100));
+        }
+
+        WHEN("a member in the middle is erased") {
+            REQUIRE(members.Erase(third->GetAvatarId()));
+            REQUIRE_FALSE(members.Erase(third->GetAvatarId()));
+
+            THEN("the order of the remaining members is preserved and its reference released") {
+                REQUIRE(members.size() == 2);
+                REQUIRE(members[0] == second);
+                REQUIRE(members[1] == first);
+                REQUIRE_FALSE(members.Contains(third->GetAvatarId()));
+                REQUIRE_FALSE(third->IsReferenced());
+            }
+        }
+
+        WHEN("the set is cleared") {
+            members.Clear();
+
+            THEN("every reference is released") {
+                REQUIRE(members.empty());
+                REQUIRE_FALSE(first->IsReferenced());
+                REQUIRE_FALSE(second->IsReferenced());
+                REQUIRE_FALSE(third->IsReferenced());
+            }
+        }
+    }
+}
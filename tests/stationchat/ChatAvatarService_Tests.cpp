@@ -0,0 +1,267 @@
+#include "catch.hpp"
+
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "FakeDatabaseConnection.hpp"
+#include "StringUtils.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+SCENARIO("avatar cache resolves avatars by id and by name and address", "[stationchat][avatarservice]") {
+    FakeDatabaseConnection db;
+    ChatAvatarService service{&db};
+
+    GIVEN("a set of created avatars sharing names across addresses") {
+        auto* corelliaBob = service.CreateAvatar(u"bob", u"corellia", 1, 0, u"coronet");
+        auto* nabooBob = service.CreateAvatar(u"bob", u"naboo", 2, 0, u"theed");
+
+        THEN("both lookup paths resolve to the same cached instance") {
+            REQUIRE(service.GetAvatar(u"bob", u"corellia") == corelliaBob);
+            REQUIRE(service.GetAvatar(u"bob", u"naboo") == nabooBob);
+            REQUIRE(service.GetAvatar(corelliaBob->GetAvatarId()) == corelliaBob);
+            REQUIRE(service.GetAvatar(nabooBob->GetAvatarId()) == nabooBob);
+        }
+
+        WHEN("one of the avatars is destroyed") {
+            auto destroyedId = corelliaBob->GetAvatarId();
+            service.DestroyAvatar(corelliaBob);
+
+            THEN("neither index resolves it any longer") {
+                REQUIRE(service.GetAvatar(u"bob", u"corellia") == nullptr);
+                REQUIRE(service.GetAvatar(destroyedId) == nullptr);
+            }
+
+            THEN("the remaining avatar is still indexed") {
+                REQUIRE(service.GetAvatar(u"bob", u"naboo") == nabooBob);
+                REQUIRE(service.GetAvatar(nabooBob->GetAvatarId()) == nabooBob);
+            }
+        }
+    }
+}
+
+SCENARIO("avatar cache evicts least recently used unpinned avatars", "[stationchat][avatarservice]") {
+    FakeDatabaseConnection db;
+    ChatAvatarService service{&db, 2};
+
+    GIVEN("more offline, unreferenced avatars than the cache can hold") {
+        auto* first = service.CreateAvatar(u"first", u"corellia", 1, 0, u"coronet");
+        auto* second = service.CreateAvatar(u"second", u"corellia", 2, 0, u"coronet");
+        auto* third = service.CreateAvatar(u"third", u"corellia", 3, 0, u"coronet");
+        auto secondId = second->GetAvatarId();
+
+        WHEN("the oldest avatar is touched before eviction runs") {
+            REQUIRE(service.GetAvatar(first->GetAvatarId()) == first);
+            service.EvictAvatars();
+
+            THEN("the least recently used avatar is evicted instead") {
+                REQUIRE(service.GetCachedAvatarCount() == 2);
+                REQUIRE(service.GetCacheStats().evictions == 1);
+                REQUIRE(service.GetAvatar(first->GetAvatarId()) == first);
+                REQUIRE(service.GetAvatar(third->GetAvatarId()) == third);
+            }
+
+            THEN("the evicted avatar is reloaded from storage on the next lookup") {
+                auto misses = service.GetCacheStats().misses;
+                service.GetAvatar(secondId);
+                REQUIRE(service.GetCacheStats().misses == misses + 1);
+            }
+        }
+    }
+
+    GIVEN("an online avatar and the target of its friend list at the cold end of the cache") {
+        auto* online = service.CreateAvatar(u"online", u"corellia", 1, 0, u"coronet");
+        auto* target = service.CreateAvatar(u"target", u"corellia", 2, 0, u"coronet");
+        auto targetId = target->GetAvatarId();
+        auto idleId = service.CreateAvatar(u"idle", u"corellia", 3, 0, u"coronet")->GetAvatarId();
+        auto* recent = service.CreateAvatar(u"recent", u"corellia", 4, 0, u"coronet");
+
+        online->AddFriend(target);
+        service.LoginAvatar(online);
+
+        WHEN("eviction runs") {
+            service.EvictAvatars();
+
+            THEN("only the online avatar is pinned; friend list entries do not pin their targets") {
+                REQUIRE(service.GetCachedAvatarCount() == 2);
+                REQUIRE(service.GetCacheStats().evictions == 2);
+                REQUIRE(service.GetAvatar(online->GetAvatarId()) == online);
+                REQUIRE(service.GetAvatar(recent->GetAvatarId()) == recent);
+            }
+
+            THEN("the evicted friend is still listed by id and display name") {
+                REQUIRE(online->GetFriendList().size() == 1);
+                REQUIRE(online->GetFriendList()[0].avatarId == targetId);
+                REQUIRE(online->GetFriendList()[0].name == u"target");
+                REQUIRE_FALSE(online->IsContactOnline(targetId));
+            }
+
+            THEN("the idle avatar is gone from the cache") {
+                auto misses = service.GetCacheStats().misses;
+                service.GetAvatar(idleId);
+                REQUIRE(service.GetCacheStats().misses == misses + 1);
+            }
+        }
+
+        WHEN("the owner logs out") {
+            service.LogoutAvatar(online);
+            service.EvictAvatars();
+
+            THEN("it becomes eligible for eviction again") {
+                REQUIRE(service.GetCachedAvatarCount() == 2);
+                REQUIRE(service.GetCacheStats().evictions == 2);
+                REQUIRE(service.GetAvatar(recent->GetAvatarId()) == recent);
+            }
+        }
+    }
+
+    GIVEN("an online avatar that eviction passed over while it was pinned") {
+        auto* online = service.CreateAvatar(u"online", u"corellia", 1, 0, u"coronet");
+        auto onlineId = online->GetAvatarId();
+        service.CreateAvatar(u"idle", u"corellia", 2, 0, u"coronet");
+        auto* used = service.CreateAvatar(u"used", u"corellia", 3, 0, u"coronet");
+
+        service.LoginAvatar(online);
+        service.EvictAvatars();
+        REQUIRE(service.GetCacheStats().evictions == 1);
+
+        WHEN("it logs out once more avatars have been used since") {
+            auto* latest = service.CreateAvatar(u"latest", u"corellia", 4, 0, u"coronet");
+            service.LogoutAvatar(online);
+            service.EvictAvatars();
+
+            THEN("it is evicted ahead of them, as the least recently used") {
+                REQUIRE(service.GetCacheStats().evictions == 2);
+                REQUIRE(service.GetAvatar(used->GetAvatarId()) == used);
+                REQUIRE(service.GetAvatar(latest->GetAvatarId()) == latest);
+
+                auto misses = service.GetCacheStats().misses;
+                service.GetAvatar(onlineId);
+                REQUIRE(service.GetCacheStats().misses == misses + 1);
+            }
+        }
+    }
+}
+
+SCENARIO("loading an avatar does not load the avatars on its contact lists", "[stationchat][avatarservice]") {
+    FakeDatabaseConnection db;
+    db.AddResult("o.id = @avatar_id", {FakeRow{"0", "1", "10", "owner", "corellia", "0", ""},
+                                          FakeRow{"1", "2", "0", "first", "corellia", "0", "best friend"},
+                                          FakeRow{"1", "3", "0", "second", "naboo", "0", ""},
+                                          FakeRow{"2", "4", "0", "ignored", "tatooine", "0", ""}});
+    ChatAvatarService service{&db};
+
+    auto* owner = service.GetAvatar(1);
+
+    THEN("the avatar and both of its lists are hydrated in a single round trip") {
+        REQUIRE(owner != nullptr);
+        REQUIRE(owner->GetUserId() == 10);
+        REQUIRE(owner->GetName() == u"owner");
+        REQUIRE(db.GetPreparedStatements().size() == 1);
+        REQUIRE(service.GetCachedAvatarCount() == 1);
+    }
+
+    THEN("contacts carry their display names without being resolved") {
+        const auto& friends = owner->GetFriendList();
+        REQUIRE(friends.size() == 2);
+        REQUIRE(friends[0].avatarId == 2);
+        REQUIRE(friends[0].name == u"first");
+        REQUIRE(friends[0].comment == u"best friend");
+        REQUIRE(friends[1].address == u"naboo");
+
+        const auto& ignored = owner->GetIgnoreList();
+        REQUIRE(ignored.size() == 1);
+        REQUIRE(ignored[0].avatarId == 4);
+        REQUIRE(ignored[0].name == u"ignored");
+    }
+
+    THEN("the friend reverse index is populated from the stubs") {
+        service.LoginAvatar(owner);
+        auto owners = service.GetOnlineAvatarsWithFriend(2);
+        REQUIRE(owners.size() == 1);
+        REQUIRE(owners[0] == owner);
+    }
+}
+
+SCENARIO("friend reverse index tracks online avatars listing a friend", "[stationchat][avatarservice]") {
+    FakeDatabaseConnection db;
+    ChatAvatarService service{&db};
+
+    auto* target = service.CreateAvatar(u"target", u"corellia", 1, 0, u"coronet");
+    auto* first = service.CreateAvatar(u"first", u"corellia", 2, 0, u"coronet");
+    auto* second = service.CreateAvatar(u"second", u"corellia", 3, 0, u"coronet");
+    auto* stranger = service.CreateAvatar(u"stranger", u"corellia", 4, 0, u"coronet");
+
+    first->AddFriend(target);
+    second->AddFriend(target);
+    service.LoginAvatar(first);
+    service.LoginAvatar(stranger);
+
+    THEN("only online avatars with the friend are returned") {
+        auto owners = service.GetOnlineAvatarsWithFriend(target->GetAvatarId());
+        REQUIRE(owners.size() == 1);
+        REQUIRE(owners[0] == first);
+    }
+
+    WHEN("the second owner logs in and the first removes the friend") {
+        service.LoginAvatar(second);
+        first->RemoveFriend(target);
+
+        THEN("the index follows both changes") {
+            auto owners = service.GetOnlineAvatarsWithFriend(target->GetAvatarId());
+            REQUIRE(owners.size() == 1);
+            REQUIRE(owners[0] == second);
+        }
+    }
+
+    WHEN("the friend is replaced by an ignore") {
+        first->AddIgnore(target);
+
+        THEN("the owner is no longer notified") {
+            REQUIRE(service.GetOnlineAvatarsWithFriend(target->GetAvatarId()).empty());
+        }
+    }
+}
+
+SCENARIO("hydrating an avatar that does not exist yields nothing", "[stationchat][avatarservice]") {
+    FakeDatabaseConnection db;
+    ChatAvatarService service{&db};
+
+    REQUIRE(service.GetAvatar(u"missing", u"corellia") == nullptr);
+    REQUIRE(db.GetPreparedStatements().size() == 1);
+    REQUIRE(service.GetCachedAvatarCount() == 0);
+}
+
+SCENARIO("avatar cache lookup cost stays flat as the cache grows", "[.][benchmark][avatarservice]") {
+    const std::vector<uint32_t> cacheSizes{1000, 10000, 100000};
+    const uint32_t lookups = 200000;
+
+    for (auto cacheSize : cacheSizes) {
+        FakeDatabaseConnection db;
+        ChatAvatarService service{&db};
+
+        std::vector<std::u16string> names;
+        std::vector<uint32_t> ids;
+        for (uint32_t i = 0; i < cacheSize; ++i) {
+            names.push_back(ToWideString("avatar" + std::to_string(i)));
+            ids.push_back(service.CreateAvatar(names.back(), u"corellia", i, 0, u"coronet")->GetAvatarId());
+        }
+
+        uint32_t found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < lookups; ++i) {
+            auto index = (i * 7919) % cacheSize;
+            found += service.GetAvatar(ids[index]) != nullptr;
+            found += service.GetAvatar(names[index], u"corellia") != nullptr;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start);
+
+        REQUIRE(found == lookups * 2);
+
+        std::cout << "avatar cache size " << cacheSize << ": "
+                  << elapsed.count() / (lookups * 2) << " ns/lookup" << std::endl;
+    }
+}
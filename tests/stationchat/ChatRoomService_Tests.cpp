@@ -0,0 +1,242 @@
+#include "catch.hpp"
+
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "ChatRoom.hpp"
+#include "ChatRoomService.hpp"
+#include "FakeDatabaseConnection.hpp"
+#include "StringUtils.hpp"
+
+#include <easylogging++.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+SCENARIO("room registry resolves rooms by address and by id", "[stationchat][roomservice]") {
+    FakeDatabaseConnection db;
+    ChatAvatarService avatarService{&db};
+    ChatRoomService roomService{&avatarService, &db};
+
+    auto* creator = avatarService.CreateAvatar(u"creator", u"SWG+galaxy", 1, 0, u"coronet");
+
+    GIVEN("rooms on several planets") {
+        auto* tatooine = roomService.CreateRoom(
+            creator, u"chat", u"", u"", 0, 50, u"SWG+galaxy+tatooine", u"SWG+galaxy");
+        auto* naboo = roomService.CreateRoom(
+            creator, u"chat", u"", u"", 0, 50, u"SWG+galaxy+naboo", u"SWG+galaxy");
+
+        THEN("each room is resolved through either index") {
+            REQUIRE(roomService.GetRoom(u"SWG+galaxy+tatooine+chat") == tatooine);
+            REQUIRE(roomService.GetRoom(tatooine->GetRoomId()) == tatooine);
+            REQUIRE(roomService.GetRoom(u"SWG+galaxy+naboo+chat") == naboo);
+            REQUIRE(roomService.GetRoom(naboo->GetRoomId()) == naboo);
+            REQUIRE(roomService.RoomExists(u"SWG+galaxy+naboo+chat"));
+            REQUIRE_FALSE(roomService.RoomExists(u"SWG+galaxy+naboo"));
+        }
+
+        THEN("creating a room at an existing address fails") {
+            REQUIRE_THROWS_AS(roomService.CreateRoom(creator, u"chat", u"", u"", 0, 50,
+                                  u"SWG+galaxy+naboo", u"SWG+galaxy"),
+                ChatResultException);
+        }
+
+        THEN("prefix queries only return rooms under the start node") {
+            auto rooms = roomService.GetRoomSummaries(u"SWG+galaxy+naboo");
+            REQUIRE(rooms.size() == 1);
+            REQUIRE(rooms[0] == naboo);
+
+            REQUIRE(roomService.GetRoomSummaries(u"SWG+galaxy").size() == 2);
+            REQUIRE(roomService.GetRoomSummaries(u"SWG+other").empty());
+        }
+
+        THEN("the filter narrows the summaries to matching room names") {
+            roomService.CreateRoom(
+                creator, u"trade", u"", u"", 0, 50, u"SWG+galaxy+naboo", u"SWG+galaxy");
+
+            auto rooms = roomService.GetRoomSummaries(u"SWG+galaxy", u"rad");
+            REQUIRE(rooms.size() == 1);
+            REQUIRE(rooms[0]->GetRoomName() == u"trade");
+        }
+
+        THEN("private rooms are never summarized") {
+            roomService.CreateRoom(creator, u"secret", u"", u"",
+                static_cast<uint32_t>(RoomAttributes::PRIVATE), 50, u"SWG+galaxy+naboo", u"SWG+galaxy");
+
+            REQUIRE(roomService.GetRoomSummaries(u"SWG+galaxy").size() == 2);
+            REQUIRE(roomService.RoomExists(u"SWG+galaxy+naboo+secret"));
+        }
+
+        THEN("the visitor can stop the walk early") {
+            uint32_t visited = 0;
+            roomService.VisitRoomSummaries(u"SWG", u"", [&visited](ChatRoom*) {
+                ++visited;
+                return false;
+            });
+
+            REQUIRE(visited == 1);
+        }
+
+        WHEN("a room is destroyed") {
+            auto roomId = naboo->GetRoomId();
+            roomService.DestroyRoom(naboo);
+
+            THEN("it is gone from every index") {
+                REQUIRE(roomService.GetRoom(u"SWG+galaxy+naboo+chat") == nullptr);
+                REQUIRE(roomService.GetRoom(roomId) == nullptr);
+                REQUIRE(roomService.GetRoomSummaries(u"SWG+galaxy").size() == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("persistent rooms are streamed in from storage", "[stationchat][roomservice]") {
+    FakeDatabaseConnection db;
+    db.AddResult("FROM room WHERE room_address",
+        {{"11", "1", "creator", "SWG+galaxy", "cantina", "drinks", "", "", "SWG+galaxy+tatooine+cantina",
+             "0", "50", "0", "0", "0"}});
+    ChatAvatarService avatarService{&db};
+    ChatRoomService roomService{&avatarService, &db};
+
+    WHEN("rooms are loaded for a base address") {
+        roomService.LoadRoomsFromStorage(u"SWG+galaxy");
+
+        THEN("the query is streamed and each text column is read into the room") {
+            REQUIRE(db.GetStreamedStatements().size() == 1);
+
+            auto* room = roomService.GetRoom(u"SWG+galaxy+tatooine+cantina");
+            REQUIRE(room != nullptr);
+            REQUIRE(room->GetRoomTopic() == u"drinks");
+            REQUIRE(room->GetCreatorName() == u"creator");
+        }
+    }
+}
+
+SCENARIO("avatars track the rooms they have joined", "[stationchat][roomservice]") {
+    FakeDatabaseConnection db;
+    ChatAvatarService avatarService{&db};
+    ChatRoomService roomService{&avatarService, &db};
+
+    auto* creator = avatarService.CreateAvatar(u"creator", u"SWG+galaxy", 1, 0, u"coronet");
+    auto* member = avatarService.CreateAvatar(u"member", u"SWG+galaxy", 2, 0, u"coronet");
+
+    auto* first = roomService.CreateRoom(creator, u"first", u"", u"", 0, 50, u"SWG+galaxy", u"SWG+galaxy");
+    auto* second = roomService.CreateRoom(creator, u"second", u"", u"", 0, 50, u"SWG+galaxy", u"SWG+galaxy");
+
+    first->EnterRoom(member, u"");
+    second->EnterRoom(member, u"");
+
+    THEN("both rooms are reported as joined") {
+        auto joined = roomService.GetJoinedRooms(member);
+        REQUIRE(joined.size() == 2);
+        REQUIRE(joined[0] == first);
+        REQUIRE(joined[1] == second);
+        REQUIRE(roomService.GetJoinedRooms(creator).empty());
+    }
+
+    WHEN("the avatar leaves one room and is kicked from the other") {
+        first->LeaveRoom(member);
+        second->KickAvatar(creator->GetAvatarId(), member);
+
+        THEN("no rooms remain joined") {
+            REQUIRE(roomService.GetJoinedRooms(member).empty());
+        }
+    }
+
+    WHEN("a joined room is destroyed") {
+        roomService.DestroyRoom(first);
+
+        THEN("only the surviving room remains joined") {
+            auto joined = roomService.GetJoinedRooms(member);
+            REQUIRE(joined.size() == 1);
+            REQUIRE(joined[0] == second);
+        }
+    }
+}
+
+SCENARIO("room message fan-out lists each gateway address once", "[stationchat][roomservice]") {
+    FakeDatabaseConnection db;
+    ChatAvatarService avatarService{&db};
+    ChatRoomService roomService{&avatarService, &db};
+
+    auto* sender = avatarService.CreateAvatar(u"sender", u"SWG+corellia", 1, 0, u"coronet");
+    auto* listener = avatarService.CreateAvatar(u"listener", u"SWG+naboo", 2, 0, u"theed");
+    auto* ignorer = avatarService.CreateAvatar(u"ignorer", u"SWG+naboo", 3, 0, u"theed");
+
+    auto* room = roomService.CreateRoom(sender, u"room", u"", u"", 0, 50, u"SWG", u"SWG");
+    room->EnterRoom(sender, u"");
+    room->EnterRoom(listener, u"");
+    room->EnterRoom(ignorer, u"");
+    ignorer->AddIgnore(sender);
+
+    THEN("each gateway address is listed once") {
+        auto addresses = room->GetConnectedAddresses();
+        REQUIRE(addresses.size() == 2);
+        REQUIRE(addresses[0] == u"SWG+corellia");
+        REQUIRE(addresses[1] == u"SWG+naboo");
+    }
+
+    THEN("recipients ignoring the sender are left out of the shared destination list") {
+        auto recipients = room->GetAvatarIds(sender);
+        REQUIRE(recipients.size() == 2);
+        REQUIRE(recipients[0] == sender->GetAvatarId());
+        REQUIRE(recipients[1] == listener->GetAvatarId());
+    }
+}
+
+SCENARIO("room summary queries scale with the result size", "[.][benchmark][roomservice]") {
+    el::Loggers::reconfigureAllLoggers(el::ConfigurationType::Enabled, "false");
+
+    FakeDatabaseConnection db;
+    ChatAvatarService avatarService{&db};
+    ChatRoomService roomService{&avatarService, &db};
+
+    auto* creator = avatarService.CreateAvatar(u"creator", u"SWG", 1, 0, u"coronet");
+
+    // 10 galaxies x 100 planets x 100 rooms
+    std::vector<ChatRoom*> allRooms;
+    for (int galaxy = 0; galaxy < 10; ++galaxy) {
+        for (int planet = 0; planet < 100; ++planet) {
+            auto address = u"SWG+galaxy" + ToWideString(std::to_string(galaxy)) + u"+planet"
+                + ToWideString(std::to_string(planet));
+
+            for (int room = 0; room < 100; ++room) {
+                allRooms.push_back(roomService.CreateRoom(creator,
+                    u"room" + ToWideString(std::to_string(room)), u"", u"", 0, 50, address, u"SWG"));
+            }
+        }
+    }
+
+    const std::u16string startNode = u"SWG+galaxy3+planet42+";
+    const int iterations = 1000;
+
+    size_t indexed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        indexed += roomService.GetRoomSummaries(startNode).size();
+    }
+    auto indexedTime = std::chrono::steady_clock::now() - start;
+
+    size_t scanned = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (auto room : allRooms) {
+            if (room->GetRoomAddress().compare(0, startNode.length(), startNode) == 0) {
+                ++scanned;
+            }
+        }
+    }
+    auto scanTime = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(indexed == 100 * iterations);
+    REQUIRE(scanned == indexed);
+
+    std::cout << "room summaries over " << allRooms.size() << " rooms: indexed "
+              << std::chrono::duration_cast<std::chrono::microseconds>(indexedTime).count() / iterations
+              << " us/query, full scan "
+              << std::chrono::duration_cast<std::chrono::microseconds>(scanTime).count() / iterations
+              << " us/query" << std::endl;
+
+    el::Loggers::reconfigureAllLoggers(el::ConfigurationType::Enabled, "true");
+}
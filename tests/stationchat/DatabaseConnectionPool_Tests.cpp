@@ -0,0 +1,126 @@
+#include "catch.hpp"
+
+#include "DatabaseConnectionPool.hpp"
+#include "FakeDatabaseConnection.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+namespace {
+
+/** A fake connection whose health check result is controlled by the test. */
+class PingableConnection final : public IDatabaseConnection {
+public:
+    explicit PingableConnection(int id)
+        : id_{id} {}
+
+    std::unique_ptr<IStatement> Prepare(const std::string& sql) override { return db_.Prepare(sql); }
+    std::unique_ptr<ITransaction> BeginTransaction() override { return db_.BeginTransaction(); }
+    uint64_t GetLastInsertId() const override { return db_.GetLastInsertId(); }
+    std::string BackendName() const override { return db_.BackendName(); }
+    const DatabaseCapabilities& Capabilities() const override { return db_.Capabilities(); }
+
+    bool Ping() override {
+        ++pings_;
+        return healthy_;
+    }
+
+    int GetId() const { return id_; }
+    int GetPingCount() const { return pings_; }
+    void SetHealthy(bool healthy) { healthy_ = healthy; }
+
+private:
+    FakeDatabaseConnection db_;
+    int id_;
+    int pings_ = 0;
+    bool healthy_ = true;
+};
+
+PingableConnection& AsPingable(DatabaseConnectionLease& lease) {
+    return static_cast<PingableConnection&>(*lease);
+}
+
+} // namespace
+
+SCENARIO("database connection pool leases each connection to one user at a time", "[stationchat][connectionpool]") {
+    int created = 0;
+    auto factory = [&created]() { return std::make_unique<PingableConnection>(++created); };
+
+    GIVEN("a pool of two connections") {
+        DatabaseConnectionPool pool{factory, 2, std::chrono::milliseconds{0}};
+
+        THEN("both connections are opened up front") {
+            REQUIRE(created == 2);
+            REQUIRE(pool.GetStats().idle == 2);
+        }
+
+        WHEN("both are leased") {
+            auto first = pool.Lease();
+            auto second = pool.Lease();
+
+            THEN("they are distinct and none is idle") {
+                REQUIRE(AsPingable(first).GetId() != AsPingable(second).GetId());
+                REQUIRE(pool.GetStats().idle == 0);
+            }
+
+            AND_WHEN("a third lease waits for one of them to be returned") {
+                std::atomic<bool> leased{false};
+                std::thread waiter{[&pool, &leased]() {
+                    auto third = pool.Lease();
+                    leased = true;
+                }};
+
+                std::this_thread::sleep_for(std::chrono::milliseconds{20});
+                CHECK_FALSE(leased);
+
+                {
+                    auto returned = std::move(first);
+                }
+
+                waiter.join();
+
+                THEN("the wait is recorded") {
+                    REQUIRE(leased);
+
+                    auto stats = pool.GetStats();
+                    REQUIRE(stats.leases == 3);
+                    REQUIRE(stats.waits == 1);
+                    REQUIRE(stats.maxWait > std::chrono::microseconds{0});
+                    REQUIRE(stats.totalWait >= stats.maxWait);
+                }
+            }
+        }
+
+        WHEN("an idle connection no longer answers its health check") {
+            {
+                auto lease = pool.Lease();
+                AsPingable(lease).SetHealthy(false);
+            }
+
+            auto lease = pool.Lease();
+
+            THEN("it is replaced by a new connection from the factory") {
+                REQUIRE(AsPingable(lease).GetId() == 3);
+                REQUIRE(pool.GetStats().replaced == 1);
+            }
+        }
+    }
+
+    GIVEN("a pool with a long health check interval") {
+        DatabaseConnectionPool pool{factory, 1, std::chrono::seconds{30}};
+
+        WHEN("a connection is returned and leased again straight away") {
+            {
+                auto lease = pool.Lease();
+            }
+
+            auto lease = pool.Lease();
+
+            THEN("it is not pinged") {
+                REQUIRE(AsPingable(lease).GetPingCount() == 0);
+            }
+        }
+    }
+}
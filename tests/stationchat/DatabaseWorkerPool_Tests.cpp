@@ -0,0 +1,118 @@
+#include "catch.hpp"
+
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "DatabaseConnectionPool.hpp"
+#include "DatabaseWorkerPool.hpp"
+#include "FakeDatabaseConnection.hpp"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace {
+
+std::unique_ptr<IDatabaseConnection> MakeConnection() {
+    return std::make_unique<FakeDatabaseConnection>();
+}
+
+/** Pumps the pool until the expected number of continuations ran or a generous timeout. */
+size_t PumpUntil(DatabaseWorkerPool& pool, size_t expected) {
+    size_t ran = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+
+    while (ran < expected && std::chrono::steady_clock::now() < deadline) {
+        ran += pool.Pump();
+        std::this_thread::yield();
+    }
+
+    return ran;
+}
+
+} // namespace
+
+SCENARIO("database worker pool completes work on the pumping thread", "[stationchat][databasepool]") {
+    DatabaseConnectionPool connections{MakeConnection, 2};
+    DatabaseWorkerPool pool{connections, 2};
+    auto tickThread = std::this_thread::get_id();
+
+    GIVEN("work submitted to the pool") {
+        std::thread::id workThread;
+        std::thread::id continuationThread;
+        std::string result;
+
+        pool.Submit(
+            [&workThread](IDatabaseConnection& db) {
+                workThread = std::this_thread::get_id();
+                return db.BackendName();
+            },
+            [&](std::future<std::string> value) {
+                continuationThread = std::this_thread::get_id();
+                result = value.get();
+            });
+
+        THEN("the work runs on a worker and the continuation on the thread calling Pump") {
+            REQUIRE(PumpUntil(pool, 1) == 1);
+            REQUIRE(result == "mariadb");
+            REQUIRE(workThread != tickThread);
+            REQUIRE(continuationThread == tickThread);
+        }
+    }
+
+    GIVEN("work that throws") {
+        bool rethrown = false;
+
+        pool.Submit(
+            [](IDatabaseConnection&) -> int {
+                throw DatabaseException("fake", 2006, "MySQL server has gone away");
+            },
+            [&rethrown](std::future<int> value) {
+                try {
+                    value.get();
+                } catch (const DatabaseException& e) {
+                    rethrown = e.Code() == 2006;
+                }
+            });
+
+        THEN("the exception reaches the continuation") {
+            REQUIRE(PumpUntil(pool, 1) == 1);
+            REQUIRE(rethrown);
+        }
+    }
+}
+
+SCENARIO("avatars hydrated off the tick thread are adopted into the cache", "[stationchat][databasepool]") {
+    FakeDatabaseConnection db;
+    FakeDatabaseConnection workerDb;
+    workerDb.AddResult("row_kind", {{"0", "7", "70", "cold", "SWG+galaxy", "0", ""}});
+    ChatAvatarService avatarService{&db};
+
+    GIVEN("an avatar loaded on another connection") {
+        auto loaded = avatarService.LoadStoredAvatar(workerDb, u"cold", u"SWG+galaxy");
+        REQUIRE(loaded != nullptr);
+        REQUIRE(avatarService.FindCachedAvatar(u"cold", u"SWG+galaxy") == nullptr);
+
+        WHEN("it is adopted") {
+            auto avatar = avatarService.AdoptLoadedAvatar(std::move(loaded));
+
+            THEN("later lookups are served from the cache") {
+                REQUIRE(avatar->GetAvatarId() == 7);
+                REQUIRE(avatarService.FindCachedAvatar(u"cold", u"SWG+galaxy") == avatar);
+                REQUIRE(db.GetPreparedStatements().empty());
+            }
+        }
+
+        WHEN("the same avatar was cached while it was loading") {
+            auto first = avatarService.AdoptLoadedAvatar(
+                avatarService.LoadStoredAvatar(workerDb, u"cold", u"SWG+galaxy"));
+            auto second = avatarService.AdoptLoadedAvatar(std::move(loaded));
+
+            THEN("the cached avatar is kept") {
+                REQUIRE(second == first);
+                REQUIRE(avatarService.GetCachedAvatarCount() == 1);
+            }
+        }
+    }
+}
@@ -8,6 +8,7 @@
 #undef private
 
 #include "Database.hpp"
+#include "FakeDatabaseConnection.hpp"
 
 #include <map>
 #include <memory>
@@ -17,51 +18,6 @@
 
 namespace {
 
-class NoopStatement final : public IStatement {
-public:
-    int BindParameterIndex(const std::string&) const override { return 1; }
-    void BindInt(int, int64_t) override {}
-    void BindText(int, const std::string&) override {}
-    void BindBlob(int, const uint8_t*, size_t) override {}
-
-    StatementStepResult Step() override { return StatementStepResult::Done; }
-
-    int ColumnInt(int) const override { return 0; }
-    std::string ColumnText(int) const override { return ""; }
-    const uint8_t* ColumnBlob(int) const override { return nullptr; }
-    int ColumnBytes(int) const override { return 0; }
-};
-
-class NoopTransaction final : public ITransaction {
-public:
-    void Commit() override {}
-    void Rollback() override {}
-};
-
-class FakeDatabaseConnection final : public IDatabaseConnection {
-public:
-    std::unique_ptr<IStatement> Prepare(const std::string& sql) override {
-        if (sql.find("INSERT INTO avatar") != std::string::npos) {
-            ++lastInsertId_;
-        }
-
-        return std::make_unique<NoopStatement>();
-    }
-
-    std::unique_ptr<ITransaction> BeginTransaction() override {
-        return std::make_unique<NoopTransaction>();
-    }
-
-    uint64_t GetLastInsertId() const override { return lastInsertId_; }
-    std::string BackendName() const override { return "mariadb"; }
-    const DatabaseCapabilities& Capabilities() const override { return capabilities_; }
-
-private:
-    uint64_t lastInsertId_ = 0;
-    DatabaseCapabilities capabilities_{UpsertStrategy::InsertIgnore, BlobSemantics::NativeBlob,
-        TransactionIsolationSupport::SerializableOnly};
-};
-
 ChatAvatar* MakeAvatar(ChatAvatarService& service, const std::u16string& name, uint32_t userId) {
     return service.CreateAvatar(name, u"corellia", userId, 0, u"bestine");
 }
@@ -127,6 +83,7 @@ public:
 
     int ColumnInt(int) const override { return 0; }
     std::string ColumnText(int) const override { return ""; }
+    boost::string_ref ColumnTextView(int) const override { return {}; }
     const uint8_t* ColumnBlob(int) const override { return nullptr; }
     int ColumnBytes(int) const override { return 0; }
 
@@ -204,14 +161,14 @@ SCENARIO("chat avatar removals erase the entire removed tail range", "[stationch
     owner->RemoveFriend(remove);
 
     REQUIRE(owner->friendList_.size() == 1);
-    REQUIRE(owner->friendList_[0].frnd->GetAvatarId() == keep->GetAvatarId());
+    REQUIRE(owner->friendList_[0].avatarId == keep->GetAvatarId());
 
     owner->ignoreList_ = {IgnoreContact{remove}, IgnoreContact{keep}, IgnoreContact{remove}};
 
     owner->RemoveIgnore(remove);
 
     REQUIRE(owner->ignoreList_.size() == 1);
-    REQUIRE(owner->ignoreList_[0].ignored->GetAvatarId() == keep->GetAvatarId());
+    REQUIRE(owner->ignoreList_[0].avatarId == keep->GetAvatarId());
 }
 
 SCENARIO("chat room and room service removals do not leave ghost entries", "[stationchat][room]") {
@@ -251,23 +208,18 @@ SCENARIO("chat room and room service removals do not leave ghost entries", "[sta
     REQUIRE(room.invited_[0]->GetAvatarId() == keep->GetAvatarId());
 
     ChatRoomService roomService{&avatarService, &db};
-    auto trackedA = std::make_unique<ChatRoom>();
-    trackedA->roomId_ = 100;
-    auto trackedB = std::make_unique<ChatRoom>();
-    trackedB->roomId_ = 200;
-    auto trackedC = std::make_unique<ChatRoom>();
-    trackedC->roomId_ = 200;
-
-    auto* trackedBPtr = trackedB.get();
-
-    roomService.rooms_.emplace_back(std::move(trackedA));
-    roomService.rooms_.emplace_back(std::move(trackedB));
-    roomService.rooms_.emplace_back(std::move(trackedC));
+    auto* trackedA = roomService.CreateRoom(creator, u"a", u"", u"", 0, 50, u"swg", u"swg");
+    auto* trackedB = roomService.CreateRoom(creator, u"b", u"", u"", 0, 50, u"swg", u"swg");
+    auto trackedAId = trackedA->GetRoomId();
+    auto trackedBId = trackedB->GetRoomId();
 
-    roomService.DestroyRoom(trackedBPtr);
+    roomService.DestroyRoom(trackedB);
 
     REQUIRE(roomService.rooms_.size() == 1);
-    REQUIRE(roomService.rooms_[0]->GetRoomId() == 100);
+    REQUIRE(roomService.rooms_.begin()->second->GetRoomId() == trackedAId);
+    REQUIRE(roomService.GetRoom(trackedBId) == nullptr);
+    REQUIRE(roomService.GetRoom(u"swg+b") == nullptr);
+    REQUIRE(roomService.summaryIndex_.size() == 1);
 }
 
 SCENARIO("logout removes all matching online avatars", "[stationchat][avatarservice]") {
@@ -277,14 +229,14 @@ SCENARIO("logout removes all matching online avatars", "[stationchat][avatarserv
     auto* keep = MakeAvatar(service, u"keep", 21);
     auto* remove = MakeAvatar(service, u"remove", 22);
 
-    remove->isOnline_ = true;
-    keep->isOnline_ = true;
-    service.onlineAvatars_ = {remove, keep, remove};
+    service.LoginAvatar(remove);
+    service.LoginAvatar(keep);
+    service.LoginAvatar(remove);
 
     service.LogoutAvatar(remove);
 
     REQUIRE(service.onlineAvatars_.size() == 1);
-    REQUIRE(service.onlineAvatars_[0]->GetAvatarId() == keep->GetAvatarId());
+    REQUIRE(service.onlineAvatars_.at(keep->GetAvatarId()) == keep);
     REQUIRE(remove->IsOnline() == false);
 }
 
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Database.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using FakeRow = std::vector<std::string>;
+
+class NoopStatement final : public IStatement {
+public:
+    int BindParameterIndex(const std::string&) const override { return 1; }
+    void BindInt(int, int64_t) override {}
+    void BindText(int, const std::string&) override {}
+    void BindBlob(int, const uint8_t*, size_t) override {}
+
+    StatementStepResult Step() override { return StatementStepResult::Done; }
+
+    int ColumnInt(int) const override { return 0; }
+    std::string ColumnText(int) const override { return ""; }
+    boost::string_ref ColumnTextView(int) const override { return {}; }
+    const uint8_t* ColumnBlob(int) const override { return nullptr; }
+    int ColumnBytes(int) const override { return 0; }
+};
+
+/** Returns canned rows; every column is stored as text and converted on read. */
+class FakeResultStatement final : public IStatement {
+public:
+    explicit FakeResultStatement(std::vector<FakeRow> rows, std::string sql = {},
+        std::vector<std::string>* streamedStatements = nullptr)
+        : rows_{std::move(rows)}
+        , sql_{std::move(sql)}
+        , streamedStatements_{streamedStatements} {}
+
+    int BindParameterIndex(const std::string&) const override { return 1; }
+    void BindInt(int, int64_t) override {}
+    void BindText(int, const std::string&) override {}
+    void BindBlob(int, const uint8_t*, size_t) override {}
+
+    void EnableStreaming() override {
+        if (current_ != static_cast<size_t>(-1)) {
+            throw DatabaseException("fake", 0, "streaming enabled after the first step");
+        }
+
+        if (streamedStatements_) {
+            streamedStatements_->push_back(sql_);
+        }
+    }
+
+    StatementStepResult Step() override {
+        return ++current_ < rows_.size() ? StatementStepResult::Row : StatementStepResult::Done;
+    }
+
+    int ColumnInt(int index) const override { return std::stoi(rows_[current_][index]); }
+    std::string ColumnText(int index) const override { return rows_[current_][index]; }
+    boost::string_ref ColumnTextView(int index) const override { return rows_[current_][index]; }
+    const uint8_t* ColumnBlob(int index) const override {
+        return reinterpret_cast<const uint8_t*>(rows_[current_][index].data());
+    }
+    int ColumnBytes(int index) const override {
+        return static_cast<int>(rows_[current_][index].size());
+    }
+
+private:
+    std::vector<FakeRow> rows_;
+    std::string sql_;
+    std::vector<std::string>* streamedStatements_;
+    size_t current_ = static_cast<size_t>(-1);
+};
+
+class NoopTransaction final : public ITransaction {
+public:
+    void Commit() override {}
+    void Rollback() override {}
+};
+
+class FakeDatabaseConnection final : public IDatabaseConnection {
+public:
+    std::unique_ptr<IStatement> Prepare(const std::string& sql) override {
+        preparedStatements_.push_back(sql);
+
+        if (sql.find("INSERT INTO avatar") != std::string::npos) {
+            ++lastInsertId_;
+        }
+
+        for (const auto& result : results_) {
+            if (sql.find(result.first) != std::string::npos) {
+                return std::make_unique<FakeResultStatement>(result.second, sql, &streamedStatements_);
+            }
+        }
+
+        return std::make_unique<NoopStatement>();
+    }
+
+    /** Statements whose SQL contains sqlFragment return rows; earlier fragments win. */
+    void AddResult(const std::string& sqlFragment, std::vector<FakeRow> rows) {
+        results_.emplace_back(sqlFragment, std::move(rows));
+    }
+
+    const std::vector<std::string>& GetPreparedStatements() const { return preparedStatements_; }
+    void ClearPreparedStatements() { preparedStatements_.clear(); }
+    /** Statements with canned rows that were switched to streaming before being stepped. */
+    const std::vector<std::string>& GetStreamedStatements() const { return streamedStatements_; }
+
+    std::unique_ptr<ITransaction> BeginTransaction() override {
+        return std::make_unique<NoopTransaction>();
+    }
+
+    uint64_t GetLastInsertId() const override { return lastInsertId_; }
+    std::string BackendName() const override { return "mariadb"; }
+    const DatabaseCapabilities& Capabilities() const override { return capabilities_; }
+
+private:
+    uint64_t lastInsertId_ = 0;
+    DatabaseCapabilities capabilities_{UpsertStrategy::InsertIgnore, BlobSemantics::NativeBlob,
+        TransactionIsolationSupport::SerializableOnly};
+    std::vector<std::pair<std::string, std::vector<FakeRow>>> results_;
+    std::vector<std::string> preparedStatements_;
+    std::vector<std::string> streamedStatements_;
+};
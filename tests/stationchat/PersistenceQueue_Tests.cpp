@@ -0,0 +1,335 @@
+#include "catch.hpp"
+
+#include "ChatAvatar.hpp"
+#include "ChatAvatarService.hpp"
+#include "FakeDatabaseConnection.hpp"
+#include "PersistenceQueue.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+/** Records statements like FakeDatabaseConnection, but can hold the worker inside Prepare
+* until released and can fail a number of statements to exercise retries.
+*/
+class GatedDatabaseConnection final : public IDatabaseConnection {
+public:
+    std::unique_ptr<IStatement> Prepare(const std::string& sql) override {
+        std::unique_lock<std::mutex> lock{mutex_};
+        released_.wait(lock, [this] { return open_; });
+
+        if (failuresRemaining_ > 0) {
+            --failuresRemaining_;
+            throw DatabaseException("fake", failureCode_, "injected failure");
+        }
+
+        return db_.Prepare(sql);
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        open_ = false;
+    }
+
+    void Open() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            open_ = true;
+        }
+
+        released_.notify_all();
+    }
+
+    /** Fails the next count statements with code; the default is CR_SERVER_LOST. */
+    void FailNext(int count, int code = 2013) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        failuresRemaining_ = count;
+        failureCode_ = code;
+    }
+
+    std::vector<std::string> GetPreparedStatements() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return db_.GetPreparedStatements();
+    }
+
+    std::unique_ptr<ITransaction> BeginTransaction() override { return db_.BeginTransaction(); }
+    uint64_t GetLastInsertId() const override { return db_.GetLastInsertId(); }
+    std::string BackendName() const override { return db_.BackendName(); }
+    const DatabaseCapabilities& Capabilities() const override { return db_.Capabilities(); }
+
+private:
+    FakeDatabaseConnection db_;
+    std::mutex mutex_;
+    std::condition_variable released_;
+    bool open_ = true;
+    int failuresRemaining_ = 0;
+    int failureCode_ = 0;
+};
+
+PersistenceOp MakeOp(
+    PersistenceOpKind kind, const std::string& sql, const std::string& key, const std::string& scope) {
+    return PersistenceOp{kind, sql, {}, key, scope};
+}
+
+} // namespace
+
+SCENARIO("persistence queue applies writes in order on its own connection", "[stationchat][persistence]") {
+    auto connection = std::make_unique<GatedDatabaseConnection>();
+    auto* db = connection.get();
+    PersistenceQueue queue{std::move(connection)};
+
+    GIVEN("writes to unrelated rows") {
+        queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT 1", "a", "scope"));
+        queue.Enqueue(MakeOp(PersistenceOpKind::Update, "UPDATE 2", "b", "scope"));
+        queue.Enqueue(MakeOp(PersistenceOpKind::Delete, "DELETE 3", "c", "scope"));
+
+        WHEN("the queue is flushed") {
+            queue.Flush();
+
+            THEN("every write ran in the order it was enqueued") {
+                REQUIRE(db->GetPreparedStatements()
+                    == std::vector<std::string>({"INSERT 1", "UPDATE 2", "DELETE 3"}));
+                REQUIRE_FALSE(queue.HasPending("scope"));
+
+                auto stats = queue.GetStats();
+                REQUIRE(stats.enqueued == 3);
+                REQUIRE(stats.executed == 3);
+                REQUIRE(stats.depth == 0);
+            }
+        }
+    }
+
+    GIVEN("a worker held inside an earlier write") {
+        db->Close();
+        queue.Enqueue(MakeOp(PersistenceOpKind::Update, "UPDATE held", "held", "other"));
+
+        WHEN("a row is inserted and deleted again before either runs") {
+            queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT friend", "friend:1:2", "avatar:1"));
+            queue.Enqueue(MakeOp(PersistenceOpKind::Update, "UPDATE comment", "friend:1:2", "avatar:1"));
+            queue.Enqueue(MakeOp(PersistenceOpKind::Delete, "DELETE friend", "friend:1:2", "avatar:1"));
+
+            THEN("none of them reach the database") {
+                CHECK_FALSE(queue.HasPending("avatar:1"));
+
+                db->Open();
+                queue.Flush();
+
+                REQUIRE(db->GetPreparedStatements() == std::vector<std::string>({"UPDATE held"}));
+                REQUIRE(queue.GetStats().coalesced == 3);
+            }
+        }
+
+        WHEN("the same row is updated repeatedly") {
+            queue.Enqueue(MakeOp(PersistenceOpKind::Update, "UPDATE status 1", "pm:1:7", "pm:1"));
+            queue.Enqueue(MakeOp(PersistenceOpKind::Update, "UPDATE other", "pm:1:8", "pm:1"));
+            queue.Enqueue(MakeOp(PersistenceOpKind::Update, "UPDATE status 2", "pm:1:7", "pm:1"));
+
+            THEN("only the last update of that row runs, after the writes enqueued before it") {
+                CHECK(queue.HasPending("pm:1"));
+
+                db->Open();
+                queue.WaitForScope("pm:1");
+
+                REQUIRE(db->GetPreparedStatements()
+                    == std::vector<std::string>({"UPDATE held", "UPDATE other", "UPDATE status 2"}));
+                REQUIRE(queue.GetStats().coalesced == 1);
+            }
+        }
+
+        WHEN("a row that already exists is deleted") {
+            queue.Enqueue(MakeOp(PersistenceOpKind::Delete, "DELETE friend", "friend:1:2", "avatar:1"));
+            queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT friend", "friend:1:2", "avatar:1"));
+
+            THEN("a delete queued ahead of the insert is kept") {
+                db->Open();
+                queue.Flush();
+
+                REQUIRE(db->GetPreparedStatements()
+                    == std::vector<std::string>({"UPDATE held", "DELETE friend", "INSERT friend"}));
+                REQUIRE(queue.GetStats().coalesced == 0);
+            }
+        }
+    }
+
+    GIVEN("a connection that drops the first attempt") {
+        db->FailNext(1);
+        queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT retried", "r", "scope"));
+
+        THEN("the write is retried rather than lost") {
+            queue.Flush();
+
+            REQUIRE(db->GetPreparedStatements() == std::vector<std::string>({"INSERT retried"}));
+            REQUIRE(queue.GetStats().executed == 1);
+            REQUIRE(queue.GetStats().failed == 0);
+        }
+    }
+
+    GIVEN("a connection that stays down for longer than a few retries") {
+        db->FailNext(5);
+        queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT first", "a", "scope"));
+        queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT second", "b", "scope"));
+
+        THEN("the failing write keeps its place at the head of the queue until it succeeds") {
+            queue.Flush();
+
+            REQUIRE(db->GetPreparedStatements()
+                == std::vector<std::string>({"INSERT first", "INSERT second"}));
+            REQUIRE(queue.GetStats().retried == 5);
+            REQUIRE(queue.GetStats().executed == 2);
+            REQUIRE(queue.GetStats().failed == 0);
+        }
+    }
+
+    GIVEN("a write the database rejects") {
+        // ER_DUP_ENTRY would fail the same way on every attempt.
+        db->FailNext(1, 1062);
+        queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT duplicate", "a", "scope"));
+        queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT next", "b", "scope"));
+
+        THEN("it is discarded without a retry and the queue moves on") {
+            queue.Flush();
+
+            REQUIRE(db->GetPreparedStatements() == std::vector<std::string>({"INSERT next"}));
+            REQUIRE(queue.GetStats().retried == 0);
+            REQUIRE(queue.GetStats().failed == 1);
+            REQUIRE(queue.GetStats().executed == 1);
+        }
+    }
+
+    GIVEN("a write held up by an unresponsive connection") {
+        db->Close();
+        queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT held", "a", "scope"));
+
+        THEN("bounded waits give up and report it instead of blocking") {
+            CHECK_FALSE(queue.Flush(std::chrono::milliseconds{10}));
+            CHECK_FALSE(queue.WaitForScope("scope", std::chrono::milliseconds{10}));
+            CHECK(queue.WaitForScope("other", std::chrono::milliseconds{10}));
+
+            db->Open();
+            REQUIRE(queue.Flush(std::chrono::milliseconds{5000}));
+        }
+    }
+
+    GIVEN("a client error that is not a lost connection") {
+        // CR_COMMANDS_OUT_OF_SYNC is a usage error; reconnecting does not fix the statement.
+        db->FailNext(1, 2014);
+        queue.Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT out of sync", "a", "scope"));
+
+        THEN("it is discarded rather than retried") {
+            queue.Flush();
+
+            REQUIRE(db->GetPreparedStatements().empty());
+            REQUIRE(queue.GetStats().retried == 0);
+            REQUIRE(queue.GetStats().failed == 1);
+        }
+    }
+}
+
+SCENARIO("persistence queue shutdown while the database is unreachable", "[stationchat][persistence]") {
+    auto connection = std::make_unique<GatedDatabaseConnection>();
+    auto* db = connection.get();
+    auto queue = std::make_unique<PersistenceQueue>(std::move(connection));
+
+    GIVEN("writes stuck behind a connection that never recovers") {
+        db->FailNext(1000000);
+        queue->Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT stuck", "a", "scope"));
+        queue->Enqueue(MakeOp(PersistenceOpKind::Insert, "INSERT behind", "b", "scope"));
+
+        THEN("destroying the queue gives up on them instead of hanging") {
+            queue.reset();
+
+            REQUIRE_FALSE(queue);
+        }
+    }
+}
+
+SCENARIO("avatar contact writes go through the persistence queue", "[stationchat][persistence]") {
+    FakeDatabaseConnection db;
+
+    GIVEN("an avatar service without a queue") {
+        ChatAvatarService avatarService{&db};
+        auto* owner = avatarService.CreateAvatar(u"owner", u"SWG+galaxy", 1, 0, u"coronet");
+        auto* contact = avatarService.CreateAvatar(u"contact", u"SWG+galaxy", 2, 0, u"coronet");
+        db.ClearPreparedStatements();
+
+        WHEN("a friend is added") {
+            owner->AddFriend(contact);
+
+            THEN("the insert is executed immediately on the main connection") {
+                REQUIRE(db.GetPreparedStatements().size() == 1);
+                REQUIRE(db.GetPreparedStatements()[0].find("INSERT INTO friend") == 0);
+            }
+        }
+    }
+
+    GIVEN("an avatar service with a queue") {
+        auto connection = std::make_unique<GatedDatabaseConnection>();
+        auto* queueDb = connection.get();
+        PersistenceQueue queue{std::move(connection)};
+        ChatAvatarService avatarService{&db, 0, &queue};
+
+        auto* owner = avatarService.CreateAvatar(u"owner", u"SWG+galaxy", 1, 0, u"coronet");
+        auto* contact = avatarService.CreateAvatar(u"contact", u"SWG+galaxy", 2, 0, u"coronet");
+        db.ClearPreparedStatements();
+
+        WHEN("a friend is added while the queue is busy") {
+            queueDb->Close();
+            owner->AddFriend(contact);
+
+            THEN("the handler returns before the insert runs, on the queue's connection") {
+                CHECK(db.GetPreparedStatements().empty());
+                CHECK(queue.HasPending("avatar:" + std::to_string(owner->GetAvatarId())));
+                CHECK(owner->IsFriend(contact));
+
+                queueDb->Open();
+                queue.Flush();
+
+                REQUIRE(queueDb->GetPreparedStatements().size() == 1);
+                REQUIRE(queueDb->GetPreparedStatements()[0].find("INSERT INTO friend") == 0);
+            }
+        }
+
+        WHEN("eviction runs while the owner's friend insert is still queued") {
+            ChatAvatarService boundedService{&db, 1, &queue};
+            auto* queued = boundedService.CreateAvatar(u"queued", u"SWG+galaxy", 3, 0, u"coronet");
+            auto* other = boundedService.CreateAvatar(u"other", u"SWG+galaxy", 4, 0, u"coronet");
+
+            queueDb->Close();
+            queued->AddFriend(other);
+            boundedService.EvictAvatars();
+
+            THEN("the owner stays cached until the write lands") {
+                CHECK(boundedService.GetCacheStats().evictions == 1);
+                CHECK(boundedService.GetAvatar(queued->GetAvatarId()) == queued);
+
+                queueDb->Open();
+                queue.Flush();
+                auto* later = boundedService.CreateAvatar(u"later", u"SWG+galaxy", 5, 0, u"coronet");
+                boundedService.EvictAvatars();
+
+                REQUIRE(boundedService.GetCacheStats().evictions == 2);
+                REQUIRE(boundedService.GetCachedAvatarCount() == 1);
+                REQUIRE(boundedService.GetAvatar(later->GetAvatarId()) == later);
+            }
+        }
+
+        WHEN("the avatar is destroyed while queued writes cannot drain") {
+            queueDb->Close();
+            owner->AddFriend(contact);
+
+            THEN("the delete fails with a database error and the avatar is kept") {
+                CHECK_THROWS_AS(avatarService.DestroyAvatar(contact), DatabaseException);
+                CHECK(db.GetPreparedStatements().empty());
+                CHECK(avatarService.GetAvatar(contact->GetAvatarId()) == contact);
+
+                queueDb->Open();
+                queue.Flush();
+            }
+        }
+    }
+}
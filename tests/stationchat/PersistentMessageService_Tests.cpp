@@ -0,0 +1,271 @@
+#include "catch.hpp"
+
+#include "BinaryReader.hpp"
+#include "BinaryWriter.hpp"
+#include "FakeDatabaseConnection.hpp"
+#include "PersistentMessageService.hpp"
+#include "Serialization.hpp"
+#include "protocol/GetPersistentHeaders.hpp"
+
+#include <future>
+#include <string>
+#include <vector>
+
+SCENARIO("persistent messages are read back with their oob payload", "[stationchat][persistentmessage]") {
+    FakeDatabaseConnection db;
+    PersistentMessageService messageService{&db};
+
+    GIVEN("a stored message whose oob holds two code units") {
+        const char16_t oob[] = {u'h', 0x2603};
+        db.AddResult("FROM persistent_message WHERE id",
+            {{"5", "7", "sender", "SWG+galaxy", "subject", "100", "1", "", "mail", "body",
+                std::string(reinterpret_cast<const char*>(oob), sizeof(oob))}});
+
+        WHEN("it is read") {
+            auto message = messageService.ReadPersistentMessage(db, 7, 5);
+
+            THEN("the text columns and the oob code units are restored") {
+                REQUIRE(message.header.subject == u"subject");
+                REQUIRE(message.header.category == u"mail");
+                REQUIRE(message.message == u"body");
+                REQUIRE(message.oob == std::u16string(oob, 2));
+            }
+        }
+    }
+
+    GIVEN("a stored message whose oob has an odd byte length") {
+        db.AddResult("FROM persistent_message WHERE id",
+            {{"5", "7", "sender", "SWG+galaxy", "subject", "100", "1", "", "", "body", "abc"}});
+
+        THEN("reading it fails") {
+            REQUIRE_THROWS_AS(messageService.ReadPersistentMessage(db, 7, 5), DatabaseException);
+        }
+    }
+}
+
+namespace {
+
+PersistentHeader MakeHeader(uint32_t messageId, const std::u16string& category) {
+    PersistentHeader header;
+    header.messageId = messageId;
+    header.avatarId = 7;
+    header.category = category;
+    return header;
+}
+
+std::future<std::vector<PersistentHeader>> Loaded(std::vector<PersistentHeader> headers) {
+    std::promise<std::vector<PersistentHeader>> promise;
+    promise.set_value(std::move(headers));
+    return promise.get_future();
+}
+
+} // namespace
+
+SCENARIO("message headers of online avatars are cached and written through", "[stationchat][persistentmessage]") {
+    FakeDatabaseConnection db;
+    PersistentMessageService messageService{&db};
+
+    GIVEN("an avatar whose headers were loaded and cached") {
+        messageService.BeginHeaderLoad(7);
+        messageService.AdoptLoadedHeaders(
+            7, Loaded({MakeHeader(1, u"mail"), MakeHeader(2, u"mail"), MakeHeader(3, u"auction")}), true);
+        db.ClearPreparedStatements();
+
+        THEN("headers are served without querying the database") {
+            REQUIRE(messageService.FindCachedHeaders(7)->size() == 3);
+            REQUIRE(db.GetPreparedStatements().empty());
+        }
+
+        WHEN("a message is marked read and another is trashed") {
+            messageService.UpdateMessageStatus(7, 1, PersistentState::READ);
+            messageService.UpdateMessageStatus(7, 2, PersistentState::TRASH);
+
+            THEN("the cached headers reflect both updates") {
+                auto headers = *messageService.FindCachedHeaders(7);
+                REQUIRE(headers.size() == 2);
+                REQUIRE(headers[0].status == PersistentState::READ);
+                REQUIRE(headers[1].messageId == 3);
+            }
+        }
+
+        WHEN("a category is bulk trashed") {
+            messageService.BulkUpdateMessageStatus(7, u"mail", PersistentState::TRASH);
+
+            THEN("only headers in that category are removed") {
+                auto headers = *messageService.FindCachedHeaders(7);
+                REQUIRE(headers.size() == 1);
+                REQUIRE(headers[0].messageId == 3);
+            }
+        }
+
+        WHEN("a category holding a trashed message is bulk marked unread") {
+            messageService.UpdateMessageStatus(7, 2, PersistentState::TRASH);
+            messageService.BulkUpdateMessageStatus(7, u"mail", PersistentState::UNREAD);
+
+            THEN("the cache is dropped so the revived row is read from the database") {
+                REQUIRE(messageService.FindCachedHeaders(7) == nullptr);
+            }
+        }
+
+        WHEN("a new message is stored") {
+            PersistentMessage message;
+            message.header = MakeHeader(0, u"mail");
+            messageService.StoreMessage(message);
+
+            THEN("its header is appended") {
+                REQUIRE(messageService.FindCachedHeaders(7)->size() == 4);
+            }
+        }
+
+        WHEN("the cache is dropped at logout") {
+            messageService.DropCachedHeaders(7);
+
+            THEN("headers are read from the database again") {
+                REQUIRE(messageService.FindCachedHeaders(7) == nullptr);
+                messageService.ReadMessageHeaders(db, 7);
+                REQUIRE(db.GetPreparedStatements().size() == 1);
+            }
+        }
+    }
+
+    GIVEN("a header load in flight") {
+        messageService.BeginHeaderLoad(7);
+
+        WHEN("a status update lands before the load completes") {
+            messageService.UpdateMessageStatus(7, 1, PersistentState::DELETED);
+            auto headers = messageService.AdoptLoadedHeaders(
+                7, Loaded({MakeHeader(1, u"mail"), MakeHeader(2, u"mail")}), true);
+
+            THEN("the update is replayed onto the loaded headers") {
+                REQUIRE(headers.size() == 1);
+                REQUIRE(headers[0].messageId == 2);
+                REQUIRE(messageService.FindCachedHeaders(7)->size() == 1);
+            }
+        }
+
+        WHEN("a category is bulk marked unread before the load completes") {
+            messageService.BulkUpdateMessageStatus(7, u"mail", PersistentState::UNREAD);
+            auto headers = messageService.AdoptLoadedHeaders(
+                7, Loaded({MakeHeader(1, u"mail")}), true);
+
+            THEN("the loaded headers are returned but not cached") {
+                REQUIRE(headers.size() == 1);
+                REQUIRE(messageService.FindCachedHeaders(7) == nullptr);
+            }
+        }
+
+        WHEN("the load is adopted for an avatar that is offline") {
+            messageService.AdoptLoadedHeaders(7, Loaded({MakeHeader(1, u"mail")}), false);
+
+            THEN("nothing is cached") {
+                REQUIRE(messageService.GetCachedHeaderAvatarCount() == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("persistent headers can be listed by category and page", "[stationchat][persistentmessage]") {
+    std::vector<PersistentHeader> headers{MakeHeader(1, u"mail"), MakeHeader(2, u"auction"),
+        MakeHeader(3, u"mail"), MakeHeader(4, u"mail")};
+
+    GIVEN("a query for one category with a page size of two") {
+        PersistentHeaderQuery query;
+        query.category = u"mail";
+        query.pageSize = 2;
+
+        WHEN("the first page is selected") {
+            auto page = PersistentMessageService::SelectHeaderPage(headers, query);
+
+            THEN("it holds the first two matches and a cursor for the rest") {
+                REQUIRE(page.headers.size() == 2);
+                REQUIRE(page.headers[0].messageId == 1);
+                REQUIRE(page.headers[1].messageId == 3);
+                REQUIRE(page.nextSinceMessageId == 3);
+            }
+
+            AND_WHEN("the next page is selected from the cursor") {
+                query.sinceMessageId = page.nextSinceMessageId;
+                auto next = PersistentMessageService::SelectHeaderPage(headers, query);
+
+                THEN("it holds the remaining match and no cursor") {
+                    REQUIRE(next.headers.size() == 1);
+                    REQUIRE(next.headers[0].messageId == 4);
+                    REQUIRE(next.nextSinceMessageId == 0);
+                }
+            }
+        }
+    }
+
+    GIVEN("headers read from the database with a page size") {
+        FakeDatabaseConnection db;
+        db.AddResult("FROM persistent_message WHERE avatar_id",
+            {{"1", "7", "a", "SWG", "s", "0", "1", "", "mail"},
+                {"3", "7", "a", "SWG", "s", "0", "1", "", "mail"}});
+        PersistentMessageService messageService{&db};
+
+        PersistentHeaderQuery query;
+        query.category = u"mail";
+        query.pageSize = 1;
+        auto page = messageService.ReadMessageHeaderPage(db, 7, query);
+
+        THEN("the filters are in the query and the extra row becomes the cursor") {
+            const auto& sql = db.GetPreparedStatements().back();
+            REQUIRE(sql.find("category = @category") != std::string::npos);
+            REQUIRE(sql.find("LIMIT @limit") != std::string::npos);
+            REQUIRE(page.headers.size() == 1);
+            REQUIRE(page.nextSinceMessageId == 1);
+        }
+    }
+}
+
+SCENARIO("header requests carry an optional paging cursor", "[stationchat][persistentmessage]") {
+    BinaryWriter writer;
+    write(writer, static_cast<uint32_t>(ChatRequestType::GETPERSISTENTHEADERS));
+    write(writer, static_cast<uint32_t>(11));
+    write(writer, static_cast<uint32_t>(7));
+    write(writer, std::u16string{u"mail"});
+
+    auto readRequest = [&writer]() {
+        BinaryReader reader{reinterpret_cast<const unsigned char*>(writer.data()),
+            static_cast<int>(writer.size())};
+        read<uint32_t>(reader);
+
+        ReqGetPersistentHeaders request;
+        read(reader, request);
+        return request;
+    };
+
+    WHEN("a request from an older client ends after the category") {
+        auto request = readRequest();
+
+        THEN("it is not paged") {
+            REQUIRE(request.category == u"mail");
+            REQUIRE_FALSE(request.paged);
+        }
+
+        THEN("its category is not applied, so it still lists every header") {
+            auto query = ToHeaderQuery(request);
+            REQUIRE(query.category.empty());
+            REQUIRE_FALSE(query.IsFiltered());
+        }
+    }
+
+    WHEN("a request appends a cursor and page size") {
+        write(writer, static_cast<uint32_t>(40));
+        write(writer, static_cast<uint32_t>(25));
+        auto request = readRequest();
+
+        THEN("both are read") {
+            REQUIRE(request.paged);
+            REQUIRE(request.sinceMessageId == 40);
+            REQUIRE(request.pageSize == 25);
+        }
+
+        THEN("the listing is narrowed to its category and page") {
+            auto query = ToHeaderQuery(request);
+            REQUIRE(query.category == u"mail");
+            REQUIRE(query.sinceMessageId == 40);
+            REQUIRE(query.pageSize == 25);
+        }
+    }
+}